@@ -11,6 +11,7 @@ typedef struct procQueue procQueue;
 #define CHILDREN 1
 #define DEADCHILDREN 2
 #define ZAP 3
+#define EDF 4
 
 struct procQueue {
 	procPtr head;
@@ -44,9 +45,24 @@ struct procStruct {
 	int 			timeStarted; // the time the current time slice started
 	int 			cpuTime; // the total amount of time the process has been running	
 	int 			sliceTime; // how long the process has been running in the current time slice
+	int 			cpuMode;     // CPU_USER, CPU_KERNEL or CPU_INTERRUPT
+	int 			modeStarted; // time the process last entered cpuMode or was dispatched
+	int 			modeTime[CPU_MODES]; // us spent in each mode
+	/* periodic tasks, scheduled EDF above every priority */
+	int 			period;      // us between releases, 0 if not periodic
+	int 			budget;      // cpu time (us) a job may use before it is demoted
+	int 			relDeadline; // us after a release the job is due
+	int 			release;     // time the current job was released
+	int 			deadline;    // time the current job is due
+	int 			jobCpuStart; // cpuTime when the current job started
+	int 			edf;         // 1 if the current job is scheduled EDF
+	int 			misses;      // # of jobs that finished after their deadline
+	int 			overruns;    // # of jobs that used up their budget
+	procPtr 		nextEdfPtr;
 };
 
 #define TIMESLICE 80000
+#define EDF_FULL 1000000 // the whole cpu, in edfUtilization's units
 
 /* process statuses */
 #define EMPTY 0
@@ -55,6 +71,7 @@ struct procStruct {
 #define QUIT 4
 #define JBLOCKED 5
 #define ZBLOCKED 6
+#define PBLOCKED 7 /* waiting for the next period */
 
 struct psrBits {
 	unsigned int curMode:1;
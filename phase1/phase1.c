@@ -31,6 +31,13 @@ void enq(procQueue*, procPtr);
 procPtr deq(procQueue*);
 procPtr peek(procQueue*);
 void removeChild(procQueue*, procPtr);
+void readyAdd(procPtr);
+void readyRemove(procPtr);
+static void edfInsert(procPtr);
+static void edfRemove(procPtr);
+static void edfRelease(int);
+static int edfJobTime(procPtr, int);
+static int edfShare(int, int);
 
 /* -------------------------- Globals ------------------------------------- */
 
@@ -42,6 +49,14 @@ procStruct ProcTable[MAXPROC];
 
 // Process lists
 procQueue ReadyList[SENTINELPRIORITY];
+procQueue EdfList; // periodic jobs, earliest deadline first
+
+// The sum of budget/period of the periodic processes, in millionths,
+// each rounded up so a set over the whole cpu is never admitted
+int edfUtilization;
+
+// The number of periodic processes waiting for their next period
+int periodWaiters;
 
 // The number of process table spots taken
 int numProcs;
@@ -87,6 +102,9 @@ void startup()
     for (i = 0; i < SENTINELPRIORITY; i++) {
         initProcQueue(&ReadyList[i], READYLIST);
     }
+    initProcQueue(&EdfList, EDF);
+    edfUtilization = 0;
+    periodWaiters = 0;
 
     // Initialize the clock interrupt handler
     USLOSS_IntVec[USLOSS_CLOCK_INT] = clockHandler;
@@ -262,8 +280,11 @@ int fork1(char *name, int (*startFunc)(char *), char *arg,
         ProcTable[procSlot].parentPtr = Current; // set parent pointer
     }
 
+    // processes start out in kernel mode, in launch
+    ProcTable[procSlot].cpuMode = CPU_KERNEL;
+
     // add process to the approriate ready list
-    enq(&ReadyList[priority-1], &ProcTable[procSlot]);
+    readyAdd(&ProcTable[procSlot]);
     ProcTable[procSlot].status = READY; // set status to READY
 
     // let dispatcher decide which process runs next
@@ -300,8 +321,13 @@ void launch()
     // Enable interrupts
     enableInterrupts();
 
+    // the function passed to fork1 is user code; the handlers it enters
+    // charge their own time and go back to user mode when they return
+    cpuModeSet(CPU_USER);
+
     // Call the function passed to fork1, and capture its return value
     result = Current->startFunc(Current->startArg);
+    cpuModeSet(CPU_KERNEL);
 
     if (DEBUG && debugflag)
         USLOSS_Console("Process %d returned to launch\n", Current->pid);
@@ -312,10 +338,11 @@ void launch()
 
 /* ------------------------------------------------------------------------
    Name - dispatcher
-   Purpose - dispatches ready processes.  The process with the highest
-             priority (the first on the ready list) is scheduled to
-             run.  The old process is swapped out and the new process
-             swapped in.
+   Purpose - dispatches ready processes.  The periodic job with the
+             earliest deadline is scheduled to run, or if there is none,
+             the process with the highest priority (the first on the
+             ready list).  The old process is swapped out and the new
+             process swapped in.
    Parameters - none
    Returns - nothing
    Side Effects - the context of the machine is changed
@@ -329,15 +356,22 @@ void dispatcher(void)
     procPtr nextProcess = NULL;
 
     // if current is still running, remove it from ready list and put it back on the end 
+    // (periodic jobs stay in deadline order instead)
     if (Current->status == RUNNING) {
         Current->status = READY;
-        deq(&ReadyList[Current->priority-1]);
-        enq(&ReadyList[Current->priority-1], Current);
+        if (!Current->edf) {
+            deq(&ReadyList[Current->priority-1]);
+            enq(&ReadyList[Current->priority-1], Current);
+        }
     }
 
+    // Periodic jobs run before any priority
+    if (EdfList.size > 0)
+        nextProcess = peek(&EdfList);
+
     // Find the highest priority non-empty process queue
     int i;
-    for (i = 0; i < SENTINELPRIORITY; i++) {
+    for (i = 0; nextProcess == NULL && i < SENTINELPRIORITY; i++) {
         if (ReadyList[i].size > 0) {
             nextProcess = peek(&ReadyList[i]);
             break;
@@ -361,10 +395,14 @@ void dispatcher(void)
 
     // set slice time and time started 
     if (old != Current) {
-        if (old->pid > -1)
-            old->cpuTime += USLOSS_Clock() - old->timeStarted; // update cpu time for previous process
+        int now = USLOSS_Clock();
+        if (old->pid > -1) {
+            old->cpuTime += now - old->timeStarted; // update cpu time for previous process
+            old->modeTime[old->cpuMode] += now - old->modeStarted;
+        }
         Current->sliceTime = 0;
-        Current->timeStarted = USLOSS_Clock(); // set time started
+        Current->timeStarted = now; // set time started
+        Current->modeStarted = now;
     }
 
     // your dispatcher should call p1_switch(int old, int new) with the 
@@ -466,14 +504,16 @@ void quit(int status)
 
     Current->status = QUIT; // change status to QUIT
     Current->quitStatus = status; // store the given status
-    deq(&ReadyList[Current->priority-1]); // remove self from ready list
+    readyRemove(Current); // remove self from ready list
+    if (Current->period > 0)
+        edfUtilization -= edfShare(Current->budget, Current->period);
     if (Current->parentPtr != NULL) {
         removeChild(&Current->parentPtr->childrenQueue, Current); // remove self from parent's list of children
         enq(&Current->parentPtr->deadChildrenQueue, Current); // add self to parent's dead children list
 
         if (Current->parentPtr->status == JBLOCKED) { // unblock parent
             Current->parentPtr->status = READY;
-            enq(&ReadyList[Current->parentPtr->priority-1], Current->parentPtr);
+            readyAdd(Current->parentPtr);
         }
     }
 
@@ -481,7 +521,7 @@ void quit(int status)
     while (Current->zapQueue.size > 0) {
         procPtr zapper = deq(&Current->zapQueue);
         zapper->status = READY;
-        enq(&ReadyList[zapper->priority-1], zapper);
+        readyAdd(zapper);
     }
 
     // remove any dead children current has form the process table
@@ -591,7 +631,7 @@ int block(int newStatus) {
     disableInterrupts();
 
     Current->status = newStatus;
-    deq(&ReadyList[(Current->priority - 1)]);
+    readyRemove(Current);
     dispatcher();
 
     if (Current->zapQueue.size > 0) {
@@ -651,7 +691,7 @@ int unblockProc(int pid) {
 
     // unblock
     ProcTable[i].status = READY;
-    enq(&ReadyList[ProcTable[i].priority-1], &ProcTable[i]);
+    readyAdd(&ProcTable[i]);
     dispatcher();
 
     if (Current->zapQueue.size > 1) // return -1 if we were zapped
@@ -660,6 +700,135 @@ int unblockProc(int pid) {
 }
 
 
+/* ------------------------------------------------------------------------
+   Name - setPeriodic
+   Purpose - Makes the current process a periodic task. A job is released
+             every period microseconds and is due deadline microseconds
+             after its release. Released jobs are scheduled earliest
+             deadline first, ahead of every priority, until they have used
+             budget microseconds of cpu time; then they run on at their
+             normal priority. A period of 0 makes the process normal again.
+   Parameters - the period, budget and relative deadline in microseconds;
+                a deadline of 0 means the end of the period.
+   Returns -    -1: if the arguments are invalid, or the periodic tasks
+                    would need more than the whole cpu to meet their
+                    deadlines.
+                 0: otherwise.
+   Side Effects - calls dispatcher, the first job starts right away
+   ----------------------------------------------------------------------- */
+int setPeriodic(int period, int budget, int deadline) {
+    requireKernelMode("setPeriodic()");
+    disableInterrupts();
+
+    if (deadline == 0)
+        deadline = period;
+    if (period < 0 || (period > 0 && (budget <= 0 || budget > deadline || deadline > period))) {
+        enableInterrupts();
+        return -1;
+    }
+
+    // EDF meets every deadline as long as the utilization is at most 1
+    int utilization = 0;
+    if (period > 0)
+        utilization = edfShare(budget, period);
+    if (Current->period > 0)
+        utilization -= edfShare(Current->budget, Current->period);
+    if (edfUtilization + utilization > EDF_FULL) {
+        enableInterrupts();
+        return -1;
+    }
+    edfUtilization += utilization;
+
+    int now = USLOSS_Clock();
+    Current->status = READY;
+    readyRemove(Current);
+    Current->period = period;
+    Current->budget = budget;
+    Current->relDeadline = deadline;
+    Current->misses = 0;
+    Current->overruns = 0;
+    Current->release = now;
+    Current->deadline = now + deadline;
+    Current->jobCpuStart = Current->cpuTime + now - Current->timeStarted;
+    Current->edf = (period > 0);
+    readyAdd(Current);
+    dispatcher();
+
+    return 0;
+} /* setPeriodic */
+
+
+/* ------------------------------------------------------------------------
+   Name - waitPeriod
+   Purpose - Ends the current job of a periodic process and waits for the
+             next one to be released. Releases whose deadlines have already
+             gone by are skipped and counted as misses.
+   Parameters - none
+   Returns -    -1: if the process is not periodic.
+                 1: if the job that just ended missed its deadline.
+                 0: otherwise.
+   Side Effects - may block the process until its next release
+   ----------------------------------------------------------------------- */
+int waitPeriod(void) {
+    requireKernelMode("waitPeriod()");
+    disableInterrupts();
+
+    if (Current->period == 0) {
+        enableInterrupts();
+        return -1;
+    }
+
+    int now = USLOSS_Clock();
+    int missed = 0;
+    if (now - Current->deadline > 0) {
+        Current->misses++;
+        missed = 1;
+    }
+
+    // find the next release whose deadline can still be met
+    Current->release += Current->period;
+    while (now - (Current->release + Current->relDeadline) > 0) {
+        Current->release += Current->period;
+        Current->misses++;
+    }
+    Current->deadline = Current->release + Current->relDeadline;
+
+    if (now - Current->release < 0) {
+        // timeSlice releases the job
+        periodWaiters++;
+        block(PBLOCKED);
+    }
+    else {
+        Current->status = READY;
+        readyRemove(Current);
+        Current->edf = 1;
+        Current->jobCpuStart = Current->cpuTime + now - Current->timeStarted;
+        readyAdd(Current);
+        dispatcher();
+    }
+
+    return missed;
+} /* waitPeriod */
+
+
+/* ------------------------------------------------------------------------
+   Name - deadlineMisses
+   Purpose - Returns how many jobs of a periodic process missed their
+             deadlines.
+   Parameters - pid of the process
+   Returns - the number of misses, -1 if the process is not periodic
+   Side Effects - none
+   ----------------------------------------------------------------------- */
+int deadlineMisses(int pid) {
+    requireKernelMode("deadlineMisses()");
+
+    procPtr p = &ProcTable[pid % MAXPROC];
+    if (p->pid != pid || p->period == 0)
+        return -1;
+    return p->misses;
+} /* deadlineMisses */
+
+
 /* ------------------------------------------------------------------------
    Name - sentinel
    Purpose - The purpose of the sentinel routine is two-fold.  One
@@ -689,6 +858,10 @@ int sentinel (char *dummy)
 /* check to determine if deadlock has occurred... */
 static void checkDeadlock()
 {
+    // periodic processes are only waiting for the clock to release them
+    if (periodWaiters > 0)
+        return;
+
     // check if all other processes have quit
     if (numProcs > 1) {
         USLOSS_Console("checkDeadlock(): numProc = %d. Only Sentinel should be left. Halting...\n", numProcs);
@@ -733,6 +906,60 @@ int readtime()
 } /* readtime */
 
 
+/* ------------------------------------------------------------------------
+   Name - cpuModeSet
+   Purpose - Charges the time the current process has run since it last
+             changed mode to its old mode, and switches it to the given
+             one. Called around the system call handler and the
+             interrupt handlers.
+   Parameters - CPU_USER, CPU_KERNEL or CPU_INTERRUPT
+   Returns - the mode the process was in, so handlers can restore it
+   Side Effects - none
+   ----------------------------------------------------------------------- */
+int cpuModeSet(int mode) {
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    int now = USLOSS_Clock();
+    int old = Current->cpuMode;
+    Current->modeTime[old] += now - Current->modeStarted;
+    Current->modeStarted = now;
+    Current->cpuMode = mode;
+
+    USLOSS_PsrSet(psr);
+    return old;
+} /* cpuModeSet */
+
+
+/* ------------------------------------------------------------------------
+   Name - readCpuTimes
+   Purpose - Returns the CPU time (in microseconds) the given process has
+             spent in user code, in the kernel, and in interrupt handlers.
+   Parameters - the pid, and where to put the three times
+   Returns - -1 if there is no process with that pid, 0 otherwise
+   Side Effects - none
+   ----------------------------------------------------------------------- */
+int readCpuTimes(int pid, int *user, int *kernel, int *interrupt) {
+    requireKernelMode("readCpuTimes()");
+
+    procPtr p = &ProcTable[pid % MAXPROC];
+    if (pid < 0 || p->pid != pid || p->status == EMPTY)
+        return -1;
+
+    int times[CPU_MODES];
+    int i;
+    for (i = 0; i < CPU_MODES; i++)
+        times[i] = p->modeTime[i];
+    if (p == Current)
+        times[p->cpuMode] += USLOSS_Clock() - p->modeStarted;
+
+    *user = times[CPU_USER];
+    *kernel = times[CPU_KERNEL];
+    *interrupt = times[CPU_INTERRUPT];
+    return 0;
+} /* readCpuTimes */
+
+
 /* ------------------------------------------------------------------------
    Name - readCurStartTime
    Purpose - returns the time (in microseconds) at which the currently 
@@ -750,10 +977,11 @@ int readCurStartTime() {
 /* ------------------------------------------------------------------------
    Name - timeSlice
    Purpose - This operation calls the dispatcher if the currently executing 
-            process has exceeded its time slice; otherwise, it simply returns.
+            process has exceeded its time slice, or a periodic job should
+            preempt it; otherwise, it simply returns.
    Parameters - none
    Returns - nothing
-   Side Effects - may call dispatcher
+   Side Effects - may call dispatcher, releases periodic jobs
    ----------------------------------------------------------------------- */
 void timeSlice() {
     if (DEBUG && debugflag)
@@ -762,9 +990,31 @@ void timeSlice() {
     // test if in kernel mode; halt if in user mode
     requireKernelMode("timeSlice()"); 
     disableInterrupts();
+
+    int now = USLOSS_Clock();
+    edfRelease(now);
+
+    // a job that has used up its budget runs on at its normal priority
+    if (Current->edf && edfJobTime(Current, now) >= Current->budget) {
+        if (DEBUG && debugflag)
+            USLOSS_Console("timeSlice(): pid %d overran its budget\n", Current->pid);
+        Current->overruns++;
+        Current->status = READY;
+        readyRemove(Current);
+        Current->edf = 0;
+        readyAdd(Current);
+        dispatcher();
+        return;
+    }
+
+    // a job with an earlier deadline preempts current
+    if (EdfList.size > 0 && peek(&EdfList) != Current) {
+        dispatcher();
+        return;
+    }
    
-    Current->sliceTime = USLOSS_Clock() - Current->timeStarted;
-    if (Current->sliceTime > TIMESLICE) { // current has exceeded its timeslice
+    Current->sliceTime = now - Current->timeStarted;
+    if (!Current->edf && Current->sliceTime > TIMESLICE) { // current has exceeded its timeslice
         if (DEBUG && debugflag)
             USLOSS_Console("timeSlice(): time slicing\n");
         Current->sliceTime = 0; // reset slice time
@@ -788,6 +1038,7 @@ void emptyProc(int pid) {
     disableInterrupts();
 
     int i = pid % MAXPROC;
+    int j;
 
     ProcTable[i].status = EMPTY; // set status to be open
     ProcTable[i].pid = -1; // set pid to -1 to show it hasn't been assigned
@@ -806,6 +1057,15 @@ void emptyProc(int pid) {
     ProcTable[i].timeStarted = -1;
     ProcTable[i].cpuTime = -1;
     ProcTable[i].sliceTime = 0;
+    ProcTable[i].cpuMode = CPU_KERNEL;
+    ProcTable[i].modeStarted = 0;
+    for (j = 0; j < CPU_MODES; j++)
+        ProcTable[i].modeTime[j] = 0;
+    ProcTable[i].period = 0;
+    ProcTable[i].edf = 0;
+    ProcTable[i].misses = 0;
+    ProcTable[i].overruns = 0;
+    ProcTable[i].nextEdfPtr = NULL;
     ProcTable[i].name[0] = 0;
   
     numProcs--;
@@ -881,13 +1141,14 @@ void dumpProcesses()
 {
     requireKernelMode("dumpProcesses()");
 
-    const char *statusNames[7];
+    const char *statusNames[8];
     statusNames[EMPTY] = "EMPTY";
     statusNames[READY] = "READY";
     statusNames[RUNNING] = "RUNNING";
     statusNames[JBLOCKED] = "JOIN_BLOCK";
     statusNames[QUIT] = "QUIT";
     statusNames[ZBLOCKED] = "ZAP_BLOCK";
+    statusNames[PBLOCKED] = "PERIOD_BLOCK";
 
     //PID Parent  Priority  Status    # Kids  CPUtime Name
     int i;
@@ -995,6 +1256,91 @@ void removeChild(procQueue* q, procPtr child) {
   }
 }
 
+/* Add the process to the ready list it belongs on */
+void readyAdd(procPtr p) {
+  if (p->edf)
+    edfInsert(p);
+  else
+    enq(&ReadyList[p->priority-1], p);
+}
+
+/* Remove the process from its ready list. Normal processes are always
+ * at the head of their list when they run. */
+void readyRemove(procPtr p) {
+  if (p->edf)
+    edfRemove(p);
+  else
+    deq(&ReadyList[p->priority-1]);
+}
+
+/* Add the process to the EDF list, after the jobs due no later than it */
+static void edfInsert(procPtr p) {
+  procPtr prev = NULL;
+  procPtr q = EdfList.head;
+
+  while (q != NULL && q->deadline - p->deadline <= 0) {
+    prev = q;
+    q = q->nextEdfPtr;
+  }
+  p->nextEdfPtr = q;
+  if (prev == NULL)
+    EdfList.head = p;
+  else
+    prev->nextEdfPtr = p;
+  if (q == NULL)
+    EdfList.tail = p;
+  EdfList.size++;
+}
+
+/* Remove the process from the EDF list */
+static void edfRemove(procPtr p) {
+  procPtr prev = NULL;
+  procPtr q = EdfList.head;
+
+  while (q != NULL && q != p) {
+    prev = q;
+    q = q->nextEdfPtr;
+  }
+  if (q == NULL)
+    return;
+  if (prev == NULL)
+    EdfList.head = p->nextEdfPtr;
+  else
+    prev->nextEdfPtr = p->nextEdfPtr;
+  if (EdfList.tail == p)
+    EdfList.tail = prev;
+  p->nextEdfPtr = NULL;
+  EdfList.size--;
+}
+
+/* Release the jobs of the periodic processes whose next period has come */
+static void edfRelease(int now) {
+  int i;
+
+  for (i = 0; periodWaiters > 0 && i < MAXPROC; i++) {
+    procPtr p = &ProcTable[i];
+    if (p->status == PBLOCKED && now - p->release >= 0) {
+      p->status = READY;
+      p->edf = 1;
+      p->jobCpuStart = p->cpuTime;
+      readyAdd(p);
+      periodWaiters--;
+    }
+  }
+}
+
+/* Return budget/period in millionths of the cpu, rounded up */
+static int edfShare(int budget, int period) {
+  return (int) (((long long) budget * EDF_FULL + period - 1) / period);
+}
+
+/* Return the cpu time the current job of the process has used */
+static int edfJobTime(procPtr p, int now) {
+  if (p == Current)
+    return p->cpuTime + now - p->timeStarted - p->jobCpuStart;
+  return p->cpuTime - p->jobCpuStart;
+}
+
 /* Return the head of the given queue. */
 procPtr peek(procQueue* q) {
   if (q->head == NULL) {
@@ -31,6 +31,20 @@
 
 #define MAXSYSCALLS  50
 
+/*
+ * CPU time accounting modes. The time a process runs is charged to the
+ * mode it is in: user code (the function a process was forked with),
+ * kernel code (the system call handler), or interrupt handlers. Only
+ * phases 1 and 2 switch modes, since the later phases link the course
+ * phase 1 library, which has no cpuModeSet; phase 4 keeps its own
+ * accounting for CPUTimes through the p1_switch hook instead.
+ */
+
+#define CPU_USER       0
+#define CPU_KERNEL     1
+#define CPU_INTERRUPT  2
+#define CPU_MODES      3
+
 
 /* 
  * Function prototypes for this phase.
@@ -50,8 +64,13 @@ extern int   readCurStartTime(void);
 extern void  timeSlice(void);
 extern void  dispatcher(void);
 extern int   readtime(void);
+extern int   cpuModeSet(int mode);
+extern int   readCpuTimes(int pid, int *user, int *kernel, int *interrupt);
 extern void  disableInterrupts(void);
 extern void	 emptyProc(int i);
+extern int   setPeriodic(int period, int budget, int deadline);
+extern int   waitPeriod(void);
+extern int   deadlineMisses(int pid);
 
 extern void  p1_fork(int pid);
 extern void  p1_quit(int pid);
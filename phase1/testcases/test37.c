@@ -0,0 +1,74 @@
+/*
+ * Periodic tasks: two periodic processes, well under the whole cpu
+ * between them, run their jobs to completion while start1 waits, so the
+ * sentinel runs whenever both are waiting for their next period. A third
+ * process asking for more than the cpu that is left is turned away.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "usloss.h"
+#include "phase1.h"
+
+#define JOBS 5
+
+int Periodic(char *arg);
+int Greedy(char *arg);
+
+int start1(char *arg)
+{
+    int status, pid;
+
+    USLOSS_Console("start1(): started\n");
+    fork1("Periodic-100ms", Periodic, "100000", USLOSS_MIN_STACK, 3);
+    fork1("Periodic-200ms", Periodic, "200000", USLOSS_MIN_STACK, 3);
+    fork1("Greedy", Greedy, NULL, USLOSS_MIN_STACK, 4);
+
+    pid = join(&status);
+    USLOSS_Console("start1(): joined with pid %d, status %d\n", pid, status);
+    pid = join(&status);
+    USLOSS_Console("start1(): joined with pid %d, status %d\n", pid, status);
+    pid = join(&status);
+    USLOSS_Console("start1(): joined with pid %d, status %d\n", pid, status);
+    quit(0);
+    return 0;
+}
+
+int Periodic(char *arg)
+{
+    int period = atoi(arg);
+    int job, start, misses;
+
+    // a fifth of each period is used, and the budget is a little more
+    if (setPeriodic(period, period / 4, 0) != 0) {
+        USLOSS_Console("Periodic(): setPeriodic(%d) failed\n", period);
+        quit(1);
+    }
+    for (job = 0; job < JOBS; job++) {
+        start = USLOSS_Clock();
+        while (USLOSS_Clock() - start < period / 5)
+            ;
+        waitPeriod();
+    }
+
+    misses = deadlineMisses(getpid());
+    USLOSS_Console("Periodic(): period %d: %d jobs, %d deadline misses\n", period, JOBS, misses);
+    if (misses != 0)
+        USLOSS_Halt(1);
+    setPeriodic(0, 0, 0);
+    quit(misses);
+    return 0;
+}
+
+int Greedy(char *arg)
+{
+    int result;
+
+    // 1/4 + 1/4 of the cpu is taken; 60% more is too much
+    result = setPeriodic(100000, 60000, 0);
+    USLOSS_Console("Greedy(): setPeriodic for 60%% of the cpu returned %d\n", result);
+    if (result != -1)
+        USLOSS_Halt(1);
+    quit(0);
+    return 0;
+}
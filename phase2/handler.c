@@ -54,6 +54,7 @@ void clockHandler2(int dev, void *arg)
 {
     disableInterrupts();
     requireKernelMode("clockHandler2()");
+    int mode = cpuModeSet(CPU_INTERRUPT);
     if (DEBUG2 && debugflag2)
       USLOSS_Console("clockHandler2(): called\n");
 
@@ -61,6 +62,7 @@ void clockHandler2(int dev, void *arg)
     if (dev != USLOSS_CLOCK_DEV) {
       if (DEBUG2 && debugflag2)
         USLOSS_Console("clockHandler2(): called by other device, returning\n");
+      cpuModeSet(mode);
       return;
     }
 
@@ -75,6 +77,7 @@ void clockHandler2(int dev, void *arg)
     }
 
     timeSlice(); // call timeSlice()
+    cpuModeSet(mode);
     enableInterrupts(); // re-enable interrupts
 } /* clockHandler */
 
@@ -83,6 +86,7 @@ void diskHandler(int dev, void *arg)
 {
     disableInterrupts();
     requireKernelMode("diskHandler()");
+    int mode = cpuModeSet(CPU_INTERRUPT);
     if (DEBUG2 && debugflag2)
       USLOSS_Console("diskHandler(): called\n");
 
@@ -90,6 +94,7 @@ void diskHandler(int dev, void *arg)
     if (dev != USLOSS_DISK_DEV) {
       if (DEBUG2 && debugflag2)
         USLOSS_Console("diskHandler(): called by other device, returning\n");
+      cpuModeSet(mode);
       return;
     }
 
@@ -102,11 +107,13 @@ void diskHandler(int dev, void *arg)
     if (valid == USLOSS_DEV_INVALID) {
       if (DEBUG2 && debugflag2)
         USLOSS_Console("diskHandler(): unit number invalid, returning\n");
+      cpuModeSet(mode);
       return;
     }
 
     // conditionally send to the device's mailbox
     MboxCondSend(IOmailboxes[DISKBOX+unit], &status, sizeof(int));
+    cpuModeSet(mode);
     enableInterrupts(); // re-enable interrupts
 } /* diskHandler */
 
@@ -115,6 +122,7 @@ void termHandler(int dev, void *arg)
 {
     disableInterrupts();
     requireKernelMode("termHandler()");
+    int mode = cpuModeSet(CPU_INTERRUPT);
     if (DEBUG2 && debugflag2)
       USLOSS_Console("termHandler(): called\n");
 
@@ -122,6 +130,7 @@ void termHandler(int dev, void *arg)
     if (dev != USLOSS_TERM_DEV) {
       if (DEBUG2 && debugflag2)
         USLOSS_Console("termHandler(): called by other device, returning\n");
+      cpuModeSet(mode);
       return;
     }
 
@@ -134,11 +143,13 @@ void termHandler(int dev, void *arg)
     if (valid == USLOSS_DEV_INVALID) {
       if (DEBUG2 && debugflag2)
         USLOSS_Console("termHandler(): unit number invalid, returning\n");
+      cpuModeSet(mode);
       return;
     }
 
     // conditionally send to the device's mailbox
     MboxCondSend(IOmailboxes[TERMBOX+unit], &status, sizeof(int));
+    cpuModeSet(mode);
     enableInterrupts(); // re-enable interrupts
 } /* termHandler */
 
@@ -147,6 +158,7 @@ void syscallHandler(int dev, void *arg)
 {
   disableInterrupts();
   requireKernelMode("syscallHandler()");
+  int mode = cpuModeSet(CPU_KERNEL); // until the handler returns
   if (DEBUG2 && debugflag2)
       USLOSS_Console("syscallHandler(): called\n");
 
@@ -156,6 +168,7 @@ void syscallHandler(int dev, void *arg)
   if (dev != USLOSS_SYSCALL_INT) {
     if (DEBUG2 && debugflag2) 
       USLOSS_Console("sysCallHandler(): called by other device, returning\n");
+    cpuModeSet(mode);
     return;
   }
 
@@ -167,6 +180,7 @@ void syscallHandler(int dev, void *arg)
 
   // call nullsys for now
   nullsys((systemArgs*)arg);
+  cpuModeSet(mode);
   enableInterrupts();
 } /* syscallHandler */
 
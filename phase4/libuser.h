@@ -5,6 +5,8 @@
 #ifndef _LIBUSER_H
 #define _LIBUSER_H
 
+#include <phase4.h>
+
 // Phase 3 -- User Function Prototypes
 extern int  Spawn(char *name, int (*func)(char *), char *arg, int stack_size,
                   int priority, int *pid);
@@ -12,16 +14,28 @@ extern int  Wait(int *pid, int *status);
 extern void Terminate(int status);
 extern void GetTimeofDay(int *tod);
 extern void CPUTime(int *cpu);
+extern  int  CPUTimes(int pid, int *user, int *kernel, int *interrupt);
 extern void GetPID(int *pid);
 extern int  SemCreate(int value, int *semaphore);
 extern int  SemP(int semaphore);
 extern int  SemV(int semaphore);
 extern int  SemFree(int semaphore);
 extern  int  Sleep(int seconds);
+extern  int  SleepMs(int milliseconds);
+extern  int  SleepUs(int microseconds);
 extern  int  DiskRead (void *diskBuffer, int unit, int track, int first, int sectors, int *status);
 extern  int  DiskWrite(void *diskBuffer, int unit, int track, int first, int sectors, int *status);
 extern  int  DiskSize (int unit, int *sector, int *track, int *disk);
+extern  int  DiskStats(int unit, DiskStat *stats);
+extern  int  DiskStripe(int sectors);
+extern  int  TxBegin  (void);
+extern  int  TxWrite  (void *diskBuffer, int unit, int track, int first, int sectors);
+extern  int  TxCommit (void);
+extern  int  TxAbort  (void);
 extern  int  TermRead (char *buffer, int bufferSize, int unitID, int *numCharsRead);
 extern  int  TermWrite(char *buffer, int bufferSize, int unitID, int *numCharsRead);
+extern  int  TermReadNB(char *buffer, int bufferSize, int unitID, int *numCharsRead);
+extern  int  TermPoll (PollFd *fds, int nfds, int timeoutMs);
+extern  int  TermIoctl(int unitID, int request, TermConfig *config);
 
 #endif
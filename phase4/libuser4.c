@@ -11,6 +11,7 @@
 #include <libuser4.h>
 #include <usyscall.h>
 #include <usloss.h>
+#include <limits.h>
 
 #define CHECKMODE {    \
     if (USLOSS_PsrGet() & USLOSS_PSR_CURRENT_MODE) { \
@@ -40,6 +41,73 @@ int Sleep(int seconds) {
     return (long) sysArg.arg4;
 }
 
+/*
+ *  Routine:  SleepMs
+ *
+ *  Description: Sleeps for the given number of milliseconds.
+ *
+ *  Arguments:    int milliseconds -- time to sleep
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments or a
+ *                time too long to express in microseconds
+ *
+ */
+int SleepMs(int milliseconds) {
+    if (milliseconds < 0 || milliseconds > INT_MAX / 1000)
+        return -1;
+    return SleepUs(milliseconds * 1000);
+}
+
+/*
+ *  Routine:  SleepUs
+ *
+ *  Description: Sleeps for the given number of microseconds. The process
+ *               wakes at the first interrupt after the time is up.
+ *
+ *  Arguments:    int microseconds -- time to sleep
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments
+ *
+ */
+int SleepUs(int microseconds) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_SLEEPUS;
+    sysArg.arg1 = (void *) ((long) microseconds);
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+}
+
+/*
+ *  Routine:  CPUTimes
+ *
+ *  Description: Gets the CPU time (in microseconds) a process has spent
+ *               in user code, in system calls and in interrupt handlers.
+ *
+ *  Arguments:    int pid        -- the process
+ *                int *user      -- user time
+ *                int *kernel    -- system call time
+ *                int *interrupt -- interrupt handler time
+ *
+ *  Return Value: 0 means success, -1 means no such process
+ *
+ */
+int CPUTimes(int pid, int *user, int *kernel, int *interrupt) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_CPUTIMES;
+    sysArg.arg1 = (void *) ((long) pid);
+
+    USLOSS_Syscall(&sysArg);
+
+    *user = (long) sysArg.arg1;
+    *kernel = (long) sysArg.arg2;
+    *interrupt = (long) sysArg.arg3;
+    return (long) sysArg.arg4;
+}
+
 /*
  *  Routine:
  *
@@ -116,6 +184,149 @@ int DiskSize (int unit, int *sector, int *track, int *disk) {
     return (long) sysArg.arg4;
 }
 
+/*
+ *  Routine:  DiskStats
+ *
+ *  Description: Copies the statistics kept for the given disk unit.
+ *
+ *  Arguments:    int unit        -- disk unit
+ *                DiskStat *stats -- where to put the statistics
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments
+ *
+ */
+int DiskStats(int unit, DiskStat *stats) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_DISKSTATS;
+    sysArg.arg1 = (void *) ((long) unit);
+    sysArg.arg2 = stats;
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+}
+
+/*
+ *  Routine:  DiskStripe
+ *
+ *  Description: Sets the stripe size of the striped unit (DISK_STRIPED).
+ *               It can only be changed before the unit is first read,
+ *               written or sized.
+ *
+ *  Arguments:    int sectors -- stripe size, a divisor of the track size
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments, -2 means
+ *                the striped unit is already in use
+ *
+ */
+int DiskStripe(int sectors) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_DISKSTRIPE;
+    sysArg.arg1 = (void *) ((long) sectors);
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+}
+
+/*
+ *  Routine:  TxBegin
+ *
+ *  Description: Starts a transaction for the calling process. Writes
+ *               added with TxWrite reach the disk atomically on TxCommit.
+ *               The journal is kept on the last tracks of disk unit 0,
+ *               which DiskSize leaves out.
+ *
+ *  Arguments:    None
+ *
+ *  Return Value: 0 means success, -1 means a transaction is already open
+ *
+ */
+int TxBegin(void) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_TXBEGIN;
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+}
+
+/*
+ *  Routine:  TxWrite
+ *
+ *  Description: Adds a write to the calling process's transaction. The
+ *               data is copied, so the buffer can be reused right away.
+ *
+ *  Arguments:    void *diskBuffer -- data to write
+ *                int unit         -- disk unit
+ *                int track        -- first track to write
+ *                int first        -- first sector on the track
+ *                int sectors      -- number of sectors to write
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments, no open
+ *                transaction, or the transaction is full
+ *
+ */
+int TxWrite(void *diskBuffer, int unit, int track, int first, int sectors) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_TXWRITE;
+    sysArg.arg1 = diskBuffer;
+    sysArg.arg2 = (void *) ((long) sectors);
+    sysArg.arg3 = (void *) ((long) track);
+    sysArg.arg4 = (void *) ((long) first);
+    sysArg.arg5 = (void *) ((long) unit);
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+}
+
+/*
+ *  Routine:  TxCommit
+ *
+ *  Description: Commits the calling process's transaction, blocking
+ *               until it is in the journal.
+ *
+ *  Arguments:    None
+ *
+ *  Return Value: 0 means success, -1 means no open transaction or the
+ *                journal write failed
+ *
+ */
+int TxCommit(void) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_TXCOMMIT;
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+}
+
+/*
+ *  Routine:  TxAbort
+ *
+ *  Description: Throws away the calling process's transaction.
+ *
+ *  Arguments:    None
+ *
+ *  Return Value: 0 means success, -1 means no open transaction
+ *
+ */
+int TxAbort(void) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_TXABORT;
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+}
+
 /*
  *  Routine:
  *
@@ -133,6 +344,36 @@ int TermRead (char *buffer, int bufferSize, int unitID, int *numCharsRead) {
     sysArg.arg1 = buffer;
     sysArg.arg2 = (void *) ((long) bufferSize);
     sysArg.arg3 = (void *) ((long) unitID);
+    sysArg.arg4 = (void *) ((long) 0);
+
+    USLOSS_Syscall(&sysArg);
+
+    *numCharsRead = (long) sysArg.arg2;
+    return (long) sysArg.arg4;
+}
+
+/*
+ *  Routine:  TermReadNB
+ *
+ *  Description: Reads a line from the terminal like TermRead, but returns
+ *               right away if no line has come in yet.
+ *
+ *  Arguments:    char *buffer      -- where to put the line
+ *                int bufferSize    -- size of buffer
+ *                int unitID        -- terminal unit
+ *                int *numCharsRead -- characters read, 0 if no line
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments
+ *
+ */
+int TermReadNB(char *buffer, int bufferSize, int unitID, int *numCharsRead) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_TERMREAD;
+    sysArg.arg1 = buffer;
+    sysArg.arg2 = (void *) ((long) bufferSize);
+    sysArg.arg3 = (void *) ((long) unitID);
+    sysArg.arg4 = (void *) ((long) 1);
 
     USLOSS_Syscall(&sysArg);
 
@@ -140,6 +381,61 @@ int TermRead (char *buffer, int bufferSize, int unitID, int *numCharsRead) {
     return (long) sysArg.arg4;
 }
 
+/*
+ *  Routine:  TermPoll
+ *
+ *  Description: Waits until at least one of the given terminal units has
+ *               a line to read or one of the given mailboxes has a
+ *               message, which is received into the entry's buffer.
+ *
+ *  Arguments:    PollFd *fds   -- the entries to wait on
+ *                int nfds      -- number of entries, at most POLL_MAX
+ *                int timeoutMs -- longest time to wait, -1 for no limit,
+ *                                 0 to only check
+ *
+ *  Return Value: the number of ready entries, 0 on timeout, -1 means
+ *                invalid arguments
+ *
+ */
+int TermPoll(PollFd *fds, int nfds, int timeoutMs) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_TERMPOLL;
+    sysArg.arg1 = fds;
+    sysArg.arg2 = (void *) ((long) nfds);
+    sysArg.arg3 = (void *) ((long) timeoutMs);
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+}
+
+/*
+ *  Routine:  TermIoctl
+ *
+ *  Description: Reads (TERM_GETCONFIG) or changes (TERM_SETCONFIG) the
+ *               settings of a terminal unit.
+ *
+ *  Arguments:    int unitID         -- terminal unit
+ *                int request        -- TERM_GETCONFIG or TERM_SETCONFIG
+ *                TermConfig *config -- the settings
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments
+ *
+ */
+int TermIoctl(int unitID, int request, TermConfig *config) {
+    systemArgs sysArg;
+    CHECKMODE;
+    sysArg.number = SYS_TERMIOCTL;
+    sysArg.arg1 = (void *) ((long) unitID);
+    sysArg.arg2 = (void *) ((long) request);
+    sysArg.arg3 = config;
+
+    USLOSS_Syscall(&sysArg);
+
+    return (long) sysArg.arg4;
+}
+
 /*
  *  Routine:
  *
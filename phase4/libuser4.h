@@ -5,12 +5,26 @@
 #ifndef _LIBUSER4_H
 #define _LIBUSER4_H
 
+#include <phase4.h>
+
 // Phase 3 -- User Function Prototypes
 extern  int  Sleep(int seconds);
+extern  int  SleepMs(int milliseconds);
+extern  int  SleepUs(int microseconds);
+extern  int  CPUTimes(int pid, int *user, int *kernel, int *interrupt);
 extern  int  DiskRead (void *diskBuffer, int unit, int track, int first, int sectors, int *status);
 extern  int  DiskWrite(void *diskBuffer, int unit, int track, int first, int sectors, int *status);
 extern  int  DiskSize (int unit, int *sector, int *track, int *disk);
+extern  int  DiskStats(int unit, DiskStat *stats);
+extern  int  DiskStripe(int sectors);
+extern  int  TxBegin  (void);
+extern  int  TxWrite  (void *diskBuffer, int unit, int track, int first, int sectors);
+extern  int  TxCommit (void);
+extern  int  TxAbort  (void);
 extern  int  TermRead (char *buffer, int bufferSize, int unitID, int *numCharsRead);
 extern  int  TermWrite(char *buffer, int bufferSize, int unitID, int *numCharsRead);
+extern  int  TermReadNB(char *buffer, int bufferSize, int unitID, int *numCharsRead);
+extern  int  TermPoll (PollFd *fds, int nfds, int timeoutMs);
+extern  int  TermIoctl(int unitID, int request, TermConfig *config);
 
 #endif
@@ -2,12 +2,16 @@
 #include "usloss.h"
 #define DEBUG 0
 extern int debugflag;
+extern void cpuAcctFork(int);
+extern void cpuAcctSwitch(int, int);
+extern void cpuAcctQuit(int);
 
 void
 p1_fork(int pid)
 {
     if (DEBUG && debugflag)
         USLOSS_Console("p1_fork() called: pid = %d\n", pid);
+    cpuAcctFork(pid);
 } /* p1_fork */
 
 void
@@ -15,6 +19,7 @@ p1_switch(int old, int new)
 {
     if (DEBUG && debugflag)
         USLOSS_Console("p1_switch() called: old = %d, new = %d\n", old, new);
+    cpuAcctSwitch(old, new);
 } /* p1_switch */
 
 void
@@ -22,4 +27,5 @@ p1_quit(int pid)
 {
     if (DEBUG && debugflag)
         USLOSS_Console("p1_quit() called: pid = %d\n", pid);
+    cpuAcctQuit(pid);
 } /* p1_quit */
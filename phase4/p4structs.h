@@ -2,24 +2,237 @@
 typedef struct procStruct procStruct;
 typedef struct procStruct * procPtr;
 typedef struct diskQueue diskQueue;
+typedef struct diskReq diskReq;
+typedef struct transaction transaction;
 
 // #define BLOCKED 0
 // #define CHILDREN 1
 // #define SLEEP 2
 
+/*
+* Disk request queue, with a FIFO bucket of requests per track and a
+* bitmap of the tracks that have requests waiting, so requests are added
+* in O(1) and the next track in the sweep is found with ffs().
+*/
+#define DISKQ_BITS (8 * sizeof(unsigned int))
+
+/*
+* A read/write request for one disk unit. Each process has one per unit,
+* so a request on the striped unit can be on both units' queues at once.
+*/
+struct diskReq {
+	procPtr  proc;     /* process waiting for the request */
+	int 	 track;    /* first track */
+	int 	 firstSec; /* first sector on the first track */
+	int 	 sectors;  /* sectors left to read/write */
+	int 	 queued;   /* time the request was added to the disk queue */
+	diskReq  *next;    /* next request waiting on the same track */
+	USLOSS_DeviceRequest request;
+};
+
 struct diskQueue {
-	procPtr  head;
-	procPtr  tail;
-	procPtr  curr;
+	diskReq  **heads;      /* first request waiting on each track */
+	diskReq  **tails;      /* last request waiting on each track */
+	unsigned int *busy;    /* bitmap of tracks with requests waiting */
+	int 	 tracks;       /* number of tracks (buckets) */
+	int 	 sweep;        /* track the sweep is at */
+	diskReq  *curr;
+	int 	 size;
+};
+
+/*
+* State of the request a disk unit is working on. The disk interrupt
+* path uses it to issue the next seek/sector operation itself, so the
+* driver is only woken once the whole request is done.
+*/
+typedef struct diskUnit diskUnit;
+struct diskUnit {
+	diskReq  *req;    /* request in progress, NULL if none */
+	int 	 tracks;  /* number of tracks on the unit */
+	int 	 track;   /* track being read/written */
+	int 	 sector;  /* sector being read/written */
+	int 	 seeking; /* 1 if the last operation issued was a seek */
+	USLOSS_DeviceRequest seek; /* the seek request, kept for the device */
+	int 	 arm;     /* track the arm is on, -1 if not known yet */
+	DiskStat stats;   /* statistics for the unit */
+};
+
+/*
+* Hierarchical timer wheel, advanced on every clock interrupt. Level 0 has
+* a slot per tick, and each slot of level n covers a whole turn of level
+* n-1; timers are moved down a level when level n-1 wraps around.
+*/
+#define TIMER_BITS    6
+#define TIMER_SLOTS   (1 << TIMER_BITS)
+#define TIMER_MASK    (TIMER_SLOTS - 1)
+#define TIMER_LEVELS  4
+#define TIMER_TICK_US (USLOSS_CLOCK_MS * 1000)
+
+typedef struct timer timer;
+struct timer {
+	int 	 deadline;        /* USLOSS_Clock() time to go off at */
+	int 	 expires;         /* tick to go off at */
+	void 	 (*func)(timer *); /* called from the clock interrupt */
+	void 	 *arg;
+	timer 	 **slot;          /* slot the timer is on, NULL if not set */
+	timer 	 *next;
+	timer 	 *prev;
+};
+
+typedef struct timerWheel timerWheel;
+struct timerWheel {
+	int 	 now;      /* next tick to process */
+	int 	 lastTick; /* USLOSS_Clock() time of the last clock interrupt */
+	timer 	 *slots[TIMER_LEVELS][TIMER_SLOTS];
+};
+
+/*
+* CPU time accounting. The course phase 1 library does not charge time to
+* modes, so phase 4 does: every interrupt and system call goes through
+* cpuIntHandler, and p1_switch charges a process when it is switched out.
+* Whether a handler interrupted user code is read from the PSR, since
+* nothing is called on the way back to user mode.
+*/
+#define CPU_USER       0
+#define CPU_KERNEL     1
+#define CPU_INTERRUPT  2
+#define CPU_MODES      3
+
+typedef struct cpuAcct cpuAcct;
+struct cpuAcct {
+	int 	 pid;      /* -1 once the process has quit */
+	int 	 mode;     /* CPU_KERNEL or CPU_INTERRUPT while in the kernel */
+	int 	 started;  /* time the process entered mode or was switched in */
+	int 	 times[CPU_MODES]; /* CPU time in each mode, in us */
+};
+
+/*
+* Journal. The last JOURNAL_TRACKS tracks of JOURNAL_UNIT hold a
+* superblock sector followed by the log. They are kept for the journal
+* from startup, so DiskSize never includes them and they never hold user
+* data; the superblock is only written by the first commit, so a unit
+* nothing was committed to is left alone. Committed transactions are
+* appended to the log in groups, each a header sector followed by the
+* data, in a single sequential write. The groups are installed at their
+* home locations when the log fills up, when a direct read or write waits
+* for them, or once no commit has come for JOURNAL_IDLE_US, then the
+* superblock is rewritten to empty the log.
+*/
+#define JOURNAL_UNIT        0
+#define JOURNAL_TRACKS      4
+#define JOURNAL_MAGIC       0x4a524e4c
+#define JOURNAL_MAX_RECORDS TX_MAX_WRITES /* fits a header in a sector */
+#define JOURNAL_IDLE_US     100000
+
+typedef struct txRecord txRecord;
+struct txRecord {
+	int 	 unit;
+	int 	 track;
+	int 	 first;
+	int 	 sectors;
+};
+
+/* First sector of the journal */
+typedef struct journalSuper journalSuper;
+struct journalSuper {
+	int 	 magic;
+	int 	 seq;      /* sequence number of the first group in the log */
+};
+
+/* First sector of each group in the log */
+typedef struct journalHeader journalHeader;
+struct journalHeader {
+	int 	 magic;
+	int 	 seq;      /* one more than the group before it */
+	int 	 records;
+	int 	 sectors;  /* data sectors following the header */
+	int 	 checksum; /* of the header and data, taken with this 0 */
+	txRecord rec[JOURNAL_MAX_RECORDS];
+};
+
+struct transaction {
+	procPtr  proc;
+	int 	 records;
+	int 	 sectors;
+	int 	 status;   /* result of the commit */
+	transaction *next; /* next transaction waiting to commit */
+	txRecord rec[TX_MAX_WRITES];
+	char 	 data[TX_MAX_SECTORS * USLOSS_DISK_SECTOR_SIZE];
+};
+
+typedef struct journal journal;
+struct journal {
+	int 	 pid;
+	int 	 track;    /* first track of the journal */
+	int 	 tracks;   /* 0 if the unit is too small for a journal */
+	int 	 formatted; /* 1 once the superblock is on the disk */
+	int 	 sectors;
+	int 	 head;     /* next free sector of the log */
+	int 	 seq;      /* sequence number of the next group */
+	int 	 mbox;     /* wakes up the journal driver */
+	timer 	 idleTimer; /* goes off once commits stop coming */
+	volatile int idle; /* set when idleTimer goes off */
+	int 	 syncSem;  /* wakes up processes waiting for installs */
+	int 	 syncWaiters;
+	transaction *pending; /* transactions waiting to commit */
+	transaction *pendingTail;
+	char 	 *log;     /* copy of the journal since it was last emptied */
+	int 	 commits;
+	int 	 groups;
+	int 	 replayed;
+};
+
+/*
+* Terminal output ring for a unit. TermWrite copies lines in and the
+* terminal interrupt sends the next character whenever the transmitter
+* is ready, so a line costs no process switches per character.
+*/
+#define TERM_OUT_SIZE 256
+
+typedef struct termOut termOut;
+struct termOut {
+	char 	 buf[TERM_OUT_SIZE];
+	int 	 head;      /* next character to send */
+	int 	 tail;      /* where the next character goes */
+	int 	 xmitting;  /* 1 while transmit interrupts are on */
+	int 	 waiting;   /* 1 if a writer waits on spaceMbox */
+	int 	 spaceMbox; /* woken by the interrupt as the ring drains */
+	int 	 writeSem;  /* one writer at a time, so lines don't mix */
+	int 	 chars;     /* characters sent */
+	int 	 started;   /* time transmitting last started */
+	int 	 busyTime;  /* total time spent transmitting, in us */
+};
+
+/*
+* Terminal input ring for a unit, filled by the terminal interrupt and
+* emptied by the unit's TermReader, or in raw mode by TermRead itself.
+* Only the interrupt moves tail and only the reader moves head, so
+* neither side needs a lock.
+*/
+#define TERM_IN_SIZE 256
+
+typedef struct termIn termIn;
+struct termIn {
+	char 	 *buf;
 	int 	 size;
-	int 	 type; /* which procPtr to use for next */
+	volatile int head;     /* next character for the reader */
+	volatile int tail;     /* where the interrupt puts the next character */
+	volatile int waiting;  /* 1 if the reader waits on dataMbox */
+	int 	 dataMbox;     /* woken by the interrupt when a character comes */
+	int 	 chars;        /* characters received */
+	int 	 overflows;    /* characters dropped because the ring was full */
+	TermConfig config;
+	int 	 modeMbox;     /* wakes TermReader when raw mode is turned off */
+	int 	 readSem;      /* one raw reader at a time */
+	timer 	 vtimer;       /* raw mode VTIME timer */
+	volatile int timedOut; /* set when vtimer goes off */
 };
 
-/* Heap */
-typedef struct heap heap;
-struct heap {
-  int size;
-  procPtr procs[MAXPROC];
+/* A line passed from TermReader to termReadReal through lineReadMbox */
+typedef struct termLine termLine;
+struct termLine {
+	char 	 *data;
+	int 	 len;
 };
 
 /* 
@@ -29,12 +242,8 @@ struct procStruct {
   int         pid;
   int 		  mboxID; 
   int         blockSem;
-  int		  wakeTime;
-  int 		  diskTrack;
-  int 		  diskFirstSec;
-  int 		  diskSectors;
-  void 		  *diskBuffer;
-  procPtr 	  prevDiskPtr;
-  procPtr 	  nextDiskPtr;
-  USLOSS_DeviceRequest diskRequest;
+  timer 	  sleepTimer; /* wakes the process from Sleep */
+  diskReq 	  diskReqs[USLOSS_DISK_UNITS]; /* disk request for each unit */
+  transaction *tx; /* open transaction, NULL if none */
+  int 		  polling; /* 1 while waiting in TermPoll */
 };
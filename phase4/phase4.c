@@ -9,6 +9,8 @@
 #include <stdlib.h> /* needed for atoi() */
 #include <stdio.h>
 #include <string.h> /* needed for memcpy() */
+#include <strings.h> /* needed for ffs() */
+#include <limits.h> /* needed for INT_MAX */
 
 #define ABS(a,b) (a-b > 0 ? a-b : -(a-b))
 
@@ -19,53 +21,127 @@ static int ClockDriver(char *);
 static int DiskDriver(char *);
 static int TermDriver(char *);
 static int TermReader(char *);
-static int TermWriter(char *);
+static void termIntHandler(int, void *);
+static void termXmit(int);
+static void termSetCtrl(int);
+static void termDrain(int);
+static void termRecv(int, char);
+static int termGetc(int);
+static int termReadLine(int, int, char *, int);
+static int termReadRaw(int, int, char *, int);
+static void termVtimeExpired(timer *);
+static int termPollCheck(PollFd *, int);
+static void termPollWake(void);
+static void diskIntHandler(int, void *);
+static void clockIntHandler(int, void *);
+static void timerInsert(timer *);
+static void timerCascade(int, int);
+static void timerWakeProc(timer *);
+static void timerPoll(void);
+static void diskSeek(int);
+static int diskNextOp(int);
+static int diskHistBucket(int);
+static int diskNextTrack(diskQueue *, int);
+static int diskTracks(int);
+static void diskSubmit(procPtr, int, int, int, int, void *, int);
+static int diskStripedReal(procPtr, int, int, int, char *, int);
+static void diskStripeCopy(int, int, char *, char **, int);
+static int diskValidArgs(int, int, int, int);
+static int diskIO(int, int, int, int, void *, int);
+static int JournalDriver(char *);
+static void journalReplay(void);
+static int journalCommitGroup(void);
+static void journalCheckpoint(void);
+static void journalInstall(journalHeader *, char *);
+static int journalWrite(int, int);
+static int journalChecksum(journalHeader *);
+static int journalValid(journalHeader *);
+static void journalSync(void);
+static void journalIdle(timer *);
+static procPtr txProc(void);
+static void cpuIntHandler(int, void *);
+static int cpuModeEnter(int);
+static void cpuModeLeave(int);
 extern int start4();
 
 void sleep(systemArgs *);
+void sleepUs(systemArgs *);
 void diskRead(systemArgs *);
 void diskWrite(systemArgs *);
 void diskSize(systemArgs *);
+void diskStats(systemArgs *);
+void diskStripe(systemArgs *);
 void termRead(systemArgs *);
 void termWrite(systemArgs *);
+void termPoll(systemArgs *);
+void termIoctl(systemArgs *);
+void txBegin(systemArgs *);
+void txWrite(systemArgs *);
+void txCommit(systemArgs *);
+void txAbort(systemArgs *);
+void cpuTimes(systemArgs *);
 
 int sleepReal(int);
+int sleepUsReal(int);
 int diskSizeReal(int, int*, int*, int*);
 int diskWriteReal(int, int, int, int, void *);
 int diskReadReal(int, int, int, int, void *);
 int diskReadOrWriteReal(int, int, int, int, void *, int);
+int diskStatsReal(int, DiskStat *);
+int diskStripeReal(int);
+void printDiskStats(int);
 int termReadReal(int, int, char *);
 int termWriteReal(int, int, char *);
+int termPollReal(PollFd *, int, int);
+int termIoctlReal(int, int, TermConfig *);
+int txBeginReal(void);
+int txWriteReal(int, int, int, int, void *);
+int txCommitReal(void);
+int txAbortReal(void);
+int cpuTimesReal(int, int *, int *, int *);
+void cpuAcctFork(int);
+void cpuAcctSwitch(int, int);
+void cpuAcctQuit(int);
+void printJournalStats(void);
+void printTermStats(int);
 
 void requireKernelMode(char *);
 void emptyProc(int);
 void initProc(int);
 void setUserMode();
-void initDiskQueue(diskQueue*);
-void addDiskQ(diskQueue*, procPtr);
-procPtr peekDiskQ(diskQueue*);
-procPtr removeDiskQ(diskQueue*);
-void initHeap(heap *);
-void heapAdd(heap *, procPtr);
-procPtr heapPeek(heap *);
-procPtr heapRemove(heap *);
+void initDiskQueue(diskQueue*, int);
+void addDiskQ(diskQueue*, diskReq*);
+diskReq *peekDiskQ(diskQueue*);
+diskReq *removeDiskQ(diskQueue*);
+void timerAdd(timer *, int);
+void timerCancel(timer *);
 
 /* Globals */
 procStruct ProcTable[MAXPROC];
-heap sleepHeap;
+timerWheel timers; // timers, advanced by the clock interrupt
+void (*phase2ClockHandler)(int, void *); // phase2's clock interrupt handler
 int diskZapped; // indicates if the disk drivers are 'zapped' or not
 diskQueue diskQs[USLOSS_DISK_UNITS]; // queues for disk drivers
 int diskPids[USLOSS_DISK_UNITS]; // pids of the disk drivers
+diskUnit diskUnits[USLOSS_DISK_UNITS]; // request each disk unit is working on
+void (*phase2DiskHandler)(int, void *); // phase2's disk interrupt handler
+int diskStripeSectors = DISK_STRIPE_SECTORS; // stripe size of the striped unit
+int diskStripedUsed = 0; // 1 once the striped unit is read, written or sized
+journal diskJournal; // write-ahead log for transactions
+cpuAcct cpuAccts[MAXPROC]; // CPU time of each process, by mode
+void (*cpuHandlers[USLOSS_NUM_INTS])(int, void *); // handlers under cpuIntHandler
 
 // mailboxes for terminal device
-int charRecvMbox[USLOSS_TERM_UNITS]; // receive char
-int charSendMbox[USLOSS_TERM_UNITS]; // send char
 int lineReadMbox[USLOSS_TERM_UNITS]; // read line
-int lineWriteMbox[USLOSS_TERM_UNITS]; // write line
-int pidMbox[USLOSS_TERM_UNITS]; // pid to block
-int termInt[USLOSS_TERM_UNITS]; // interupt for term (control writing)
+int termInt[USLOSS_TERM_UNITS]; // receive interrupts are on for term
+int termLines[USLOSS_TERM_UNITS]; // lines waiting in lineReadMbox
+int pollWaiters; // number of processes waiting in TermPoll
+termIn termIns[USLOSS_TERM_UNITS]; // input ring for each term
+termOut termOuts[USLOSS_TERM_UNITS]; // output ring for each term
+int termZapping; // pass received characters to phase2 so TermDrivers wake
+void (*phase2TermHandler)(int, void *); // phase2's terminal interrupt handler
 
-int termProcTable[USLOSS_TERM_UNITS][3]; // keep track of term procs
+int termProcTable[USLOSS_TERM_UNITS][2]; // keep track of term procs
 
 
 void
@@ -90,26 +166,50 @@ start3(void)
         initProc(i);
     }
 
-    // sleep queue
-    initHeap(&sleepHeap);
+    // timers go off from the clock interrupt
+    timers.lastTick = USLOSS_Clock();
+    phase2ClockHandler = USLOSS_IntVec[USLOSS_CLOCK_INT];
+    USLOSS_IntVec[USLOSS_CLOCK_INT] = clockIntHandler;
 
     // initialize systemCallVec
     systemCallVec[SYS_SLEEP] = sleep;
+    systemCallVec[SYS_SLEEPUS] = sleepUs;
     systemCallVec[SYS_DISKREAD] = diskRead;
     systemCallVec[SYS_DISKWRITE] = diskWrite;
     systemCallVec[SYS_DISKSIZE] = diskSize;
+    systemCallVec[SYS_DISKSTATS] = diskStats;
+    systemCallVec[SYS_DISKSTRIPE] = diskStripe;
     systemCallVec[SYS_TERMREAD] = termRead;
     systemCallVec[SYS_TERMWRITE] = termWrite;
+    systemCallVec[SYS_TERMPOLL] = termPoll;
+    systemCallVec[SYS_TERMIOCTL] = termIoctl;
+    systemCallVec[SYS_TXBEGIN] = txBegin;
+    systemCallVec[SYS_TXWRITE] = txWrite;
+    systemCallVec[SYS_TXCOMMIT] = txCommit;
+    systemCallVec[SYS_TXABORT] = txAbort;
+    systemCallVec[SYS_CPUTIMES] = cpuTimes;
 
     // mboxes for terminal
     for (i = 0; i < USLOSS_TERM_UNITS; i++) {
-        charRecvMbox[i] = MboxCreate(1, MAXLINE);
-        charSendMbox[i] = MboxCreate(1, MAXLINE);
-        lineReadMbox[i] = MboxCreate(10, MAXLINE);
-        lineWriteMbox[i] = MboxCreate(10, MAXLINE); 
-        pidMbox[i] = MboxCreate(1, sizeof(int));
+        lineReadMbox[i] = MboxCreate(10, sizeof(termLine));
+        termIns[i].size = TERM_IN_SIZE;
+        termIns[i].buf = malloc(TERM_IN_SIZE);
+        termIns[i].dataMbox = MboxCreate(1, 0);
+        termIns[i].modeMbox = MboxCreate(1, 0);
+        termIns[i].readSem = semcreateReal(1);
+        termIns[i].config.vmin = 1;
+        termIns[i].config.lineSize = MAXLINE;
+        termIns[i].config.bufSize = TERM_IN_SIZE;
+        termIns[i].vtimer.func = termVtimeExpired;
+        termIns[i].vtimer.arg = &termIns[i];
+        termOuts[i].spaceMbox = MboxCreate(1, 0);
+        termOuts[i].writeSem = semcreateReal(1);
     }
 
+    // output is sent straight from the terminal interrupt
+    phase2TermHandler = USLOSS_IntVec[USLOSS_TERM_INT];
+    USLOSS_IntVec[USLOSS_TERM_INT] = termIntHandler;
+
     /*
      * Create clock device driver 
      * I am assuming a semaphore here for coordination.  A mailbox can
@@ -133,7 +233,17 @@ start3(void)
      * the stack size depending on the complexity of your
      * driver, and perhaps do something with the pid returned.
      */
-    int temp;
+    // the disk interrupt path drives multi-sector requests itself
+    phase2DiskHandler = USLOSS_IntVec[USLOSS_DISK_INT];
+    USLOSS_IntVec[USLOSS_DISK_INT] = diskIntHandler;
+
+    // CPU time is charged to modes around every handler
+    for (i = 0; i < USLOSS_NUM_INTS; i++) {
+        cpuHandlers[i] = USLOSS_IntVec[i];
+        if (cpuHandlers[i] != NULL)
+            USLOSS_IntVec[i] = cpuIntHandler;
+    }
+
     for (i = 0; i < USLOSS_DISK_UNITS; i++) {
         sprintf(diskbuf, "%d", i);
         pid = fork1("Disk driver", DiskDriver, diskbuf, USLOSS_MIN_STACK, 2);
@@ -144,10 +254,19 @@ start3(void)
 
         diskPids[i] = pid;
         sempReal(running); // wait for driver to start running
+    }
 
-        // get number of tracks
-        diskSizeReal(i, &temp, &temp, &ProcTable[pid % MAXPROC].diskTrack);
+    /*
+     * Create the journal driver, which replays the journal before any
+     * user process runs.
+     */
+    pid = fork1("Journal driver", JournalDriver, NULL, USLOSS_MIN_STACK, 2);
+    if (pid < 0) {
+        USLOSS_Console("start3(): Can't create journal driver\n");
+        USLOSS_Halt(1);
     }
+    diskJournal.pid = pid;
+    sempReal(running);
 
 
     /*
@@ -158,8 +277,6 @@ start3(void)
         sprintf(termbuf, "%d", i); 
         termProcTable[i][0] = fork1(name, TermDriver, termbuf, USLOSS_MIN_STACK, 2);
         termProcTable[i][1] = fork1(name, TermReader, termbuf, USLOSS_MIN_STACK, 2);
-        termProcTable[i][2] = fork1(name, TermWriter, termbuf, USLOSS_MIN_STACK, 2);
-        sempReal(running);
         sempReal(running);
         sempReal(running);
      }
@@ -175,6 +292,22 @@ start3(void)
     pid = spawnReal("start4", start4, NULL, 4 * USLOSS_MIN_STACK, 3);
     pid = waitReal(&status);
 
+    /*
+     * Dump the disk statistics
+     */
+    for (i = 0; i < USLOSS_DISK_UNITS; i++) {
+        printDiskStats(i);
+    }
+    printJournalStats();
+
+    /*
+     * Let the terminals finish writing, then dump their statistics
+     */
+    for (i = 0; i < USLOSS_TERM_UNITS; i++) {
+        termDrain(i);
+        printTermStats(i);
+    }
+
     /*
      * Zap the device drivers
      */
@@ -185,6 +318,11 @@ start3(void)
     zap(clockPID); 
     join(&status);
 
+    // zap journal driver, it empties the journal first
+    MboxCondSend(diskJournal.mbox, NULL, 0);
+    zap(diskJournal.pid);
+    join(&status);
+
     // zap disk drivers
     for (i = 0; i < USLOSS_DISK_UNITS; i++) {
         semvReal(ProcTable[diskPids[i]].blockSem); 
@@ -194,20 +332,15 @@ start3(void)
 
     // zap termreader
     for (i = 0; i < USLOSS_TERM_UNITS; i++) {
-        MboxSend(charRecvMbox[i], NULL, 0);
+        MboxCondSend(termIns[i].dataMbox, NULL, 0);
+        MboxCondSend(termIns[i].modeMbox, NULL, 0);
         zap(termProcTable[i][1]);
         join(&status);
     }
 
-    // zap termwriter
-    for (i = 0; i < USLOSS_TERM_UNITS; i++) {
-        MboxSend(lineWriteMbox[i], NULL, 0);
-        zap(termProcTable[i][2]);
-        join(&status);
-    }
-
     // zap termdriver, etc
     char filename[50];
+    termZapping = 1;
     for(i = 0; i < USLOSS_TERM_UNITS; i++)
     {
         int ctrl = 0;
@@ -242,25 +375,54 @@ ClockDriver(char *arg)
     semvReal(running);
     USLOSS_PsrSet(USLOSS_PsrGet() | USLOSS_PSR_CURRENT_INT);
 
-    // Infinite loop until we are zap'd
+    // Infinite loop until we are zap'd. Sleeping processes are woken by
+    // their timers in the clock interrupt, the driver just keeps waiting
+    // on the clock so the device is never idle.
     while(! isZapped()) {
 	    result = waitDevice(USLOSS_CLOCK_DEV, 0, &status);
 	    if (result != 0) {
 	        return 0;
 	    }
-
-	    // Compute the current time and wake up any processes whose time has come.
-        procPtr proc;
-        while (sleepHeap.size > 0 && USLOSS_Clock() >= heapPeek(&sleepHeap)->wakeTime) {
-            proc = heapRemove(&sleepHeap);
-            if (debug4) 
-                USLOSS_Console("ClockDriver: Waking up process %d\n", proc->pid);
-            semvReal(proc->blockSem); 
-        }
     }
     return 0;
 }
 
+/*------------------------------------------------------------------------
+    clockIntHandler: Advances the timer wheel a tick, then lets phase2
+        handle the interrupt. The wheel goes first since phase2 may
+        switch to another process.
+ ------------------------------------------------------------------------*/
+static void clockIntHandler(int dev, void *arg) {
+    int index = timers.now & TIMER_MASK;
+    int level;
+
+    timers.lastTick = USLOSS_Clock();
+
+    // when a level wraps around, bring the next slot of the level above down
+    for (level = 1; index == 0 && level < TIMER_LEVELS; level++) {
+        index = (timers.now >> (level * TIMER_BITS)) & TIMER_MASK;
+        timerCascade(level, index);
+    }
+
+    // run the timers for this tick
+    timer **slot = &timers.slots[0][timers.now & TIMER_MASK];
+    timers.now++;
+    while (*slot != NULL) {
+        timer *t = *slot;
+        *slot = t->next;
+        if (t->next != NULL)
+            t->next->prev = NULL;
+        t->slot = NULL;
+
+        if (timers.lastTick - t->deadline < 0)
+            timerInsert(t); // interrupt came early, wait another tick
+        else
+            t->func(t);
+    }
+
+    phase2ClockHandler(dev, arg);
+}
+
 /* Disk Driver */
 static int
 DiskDriver(char *arg)
@@ -272,10 +434,23 @@ DiskDriver(char *arg)
     // get set up in proc table
     initProc(getpid());
     procPtr me = &ProcTable[getpid() % MAXPROC];
-    initDiskQueue(&diskQs[unit]);
+    memset(&diskUnits[unit], 0, sizeof(diskUnit));
+    diskUnits[unit].arm = -1;
+
+    // get the number of tracks before taking requests, the disk queue
+    // keeps a bucket per track
+    USLOSS_DeviceRequest request;
+    request.opr = USLOSS_DISK_TRACKS;
+    request.reg1 = &diskUnits[unit].tracks;
+    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &request);
+    result = waitDevice(USLOSS_DISK_DEV, unit, &status);
+    if (result != 0) {
+        return 0;
+    }
+    initDiskQueue(&diskQs[unit], diskUnits[unit].tracks);
 
     if (debug4) {
-        USLOSS_Console("DiskDriver: unit %d started, pid = %d\n", unit, me->pid);
+        USLOSS_Console("DiskDriver: unit %d started, pid = %d, tracks = %d\n", unit, me->pid, diskUnits[unit].tracks);
     }
 
     // Let the parent know we are running and enable interrupts.
@@ -294,68 +469,50 @@ DiskDriver(char *arg)
 
         // get request off queue
         if (diskQs[unit].size > 0) {
-            procPtr proc = peekDiskQ(&diskQs[unit]);
-            int track = proc->diskTrack;
+            diskReq *req = peekDiskQ(&diskQs[unit]);
+            int sectors = req->sectors;
+            int start = USLOSS_Clock();
 
             if (debug4) {
-                USLOSS_Console("DiskDriver: taking request from pid %d, track %d\n", proc->pid, proc->diskTrack);
+                USLOSS_Console("DiskDriver: taking request from pid %d, track %d\n", req->proc->pid, req->track);
             }
 
-            // handle tracks request
-            if (proc->diskRequest.opr == USLOSS_DISK_TRACKS) {
-                USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &proc->diskRequest);
+            // handle read/write requests
+            if (req->sectors > 0) {
+                diskUnit *d = &diskUnits[unit];
+                d->req = req;
+                d->track = req->track + req->firstSec/USLOSS_DISK_TRACK_SIZE;
+                d->sector = req->firstSec % USLOSS_DISK_TRACK_SIZE;
+
+                // seek to the first track, the interrupt path issues the
+                // sector operations and any further seeks from there
+                diskSeek(unit);
                 result = waitDevice(USLOSS_DISK_DEV, unit, &status);
+                d->stats.wakeups++;
+                d->req = NULL;
                 if (result != 0) {
                     return 0;
                 }
-            }
 
-            else { // handle read/write requests
-                while (proc->diskSectors > 0) {
-                    // seek to needed track
-                    USLOSS_DeviceRequest request;
-                    request.opr = USLOSS_DISK_SEEK;
-                    request.reg1 = &track;
-                    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &request);
-                    // wait for result
-                    result = waitDevice(USLOSS_DISK_DEV, unit, &status);
-                    if (result != 0) {
-                        return 0;
-                    }
-
-                    if (debug4) {
-                        USLOSS_Console("DiskDriver: seeked to track %d, status = %d, result = %d\n", track, status, result);
-                    }
-
-                    // read/write the sectors
-                    int s;
-                    for (s = proc->diskFirstSec; proc->diskSectors > 0 && s < USLOSS_DISK_TRACK_SIZE; s++) {
-                        proc->diskRequest.reg1 = (void *) ((long) s);
-                        USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &proc->diskRequest);
-                        result = waitDevice(USLOSS_DISK_DEV, unit, &status);
-                        if (result != 0) {
-                            return 0;
-                        }
-
-                        if (debug4) {
-                            USLOSS_Console("DiskDriver: read/wrote sector %d, status = %d, result = %d, buffer = %s\n", s, status, result, proc->diskRequest.reg2);
-                        }
-
-                        proc->diskSectors--;
-                        proc->diskRequest.reg2 += USLOSS_DISK_SECTOR_SIZE;
-                    }
-
-                    // request first sector of next track
-                    track++;
-                    proc->diskFirstSec = 0;
+                // update the unit's statistics
+                int now = USLOSS_Clock();
+                d->stats.requests++;
+                d->stats.sectors += sectors;
+                d->stats.queueTime += start - req->queued;
+                d->stats.serviceTime += now - start;
+                d->stats.queueHist[diskHistBucket(start - req->queued)]++;
+                d->stats.serviceHist[diskHistBucket(now - start)]++;
+
+                if (debug4) {
+                    USLOSS_Console("DiskDriver: unit %d, %d operations for %d wakeups so far\n", unit, d->stats.ops, d->stats.wakeups);
                 }
             }
 
             if (debug4) 
-                USLOSS_Console("DiskDriver: finished request from pid %d\n", proc->pid, result, status);
+                USLOSS_Console("DiskDriver: finished request from pid %d\n", req->proc->pid);
 
-            removeDiskQ(&diskQs[unit]); // remove proc from queue
-            semvReal(proc->blockSem); // unblock caller
+            removeDiskQ(&diskQs[unit]); // remove request from queue
+            semvReal(req->proc->blockSem); // unblock caller
         }
 
     }
@@ -364,6 +521,86 @@ DiskDriver(char *arg)
     return 0;
 }
 
+/* ------------------------------------------------------------------------
+   Name - diskIntHandler
+   Purpose - Disk interrupt handler. While a read/write request is in
+             progress it issues the request's next operation itself, and
+             only passes the interrupt on to phase2's handler (waking the
+             driver) once the request is done or the device reports an error.
+   Parameters - the device type and the unit
+   Side Effects - may start a new disk operation or wake sleepers
+   ------------------------------------------------------------------------ */
+static void
+diskIntHandler(int dev, void *arg)
+{
+    int unit = (long) arg;
+    int status;
+
+    timerPoll(); // wake sleepers due before the next clock tick
+
+    if (dev == USLOSS_DISK_DEV && unit >= 0 && unit < USLOSS_DISK_UNITS &&
+        diskUnits[unit].req != NULL) {
+        USLOSS_DeviceInput(dev, unit, &status);
+        if (status == USLOSS_DEV_READY && diskNextOp(unit))
+            return;
+    }
+
+    phase2DiskHandler(dev, arg);
+}
+
+/* Seek the given unit to the track of its current request */
+static void
+diskSeek(int unit)
+{
+    diskUnit *d = &diskUnits[unit];
+
+    d->seek.opr = USLOSS_DISK_SEEK;
+    d->seek.reg1 = (void *) ((long) d->track);
+    d->seeking = 1;
+    d->stats.ops++;
+    d->stats.seeks++;
+    if (d->arm != -1)
+        d->stats.seekDistance += ABS(d->track, d->arm);
+    d->arm = d->track;
+    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &d->seek);
+}
+
+/*------------------------------------------------------------------------
+    diskNextOp: Issues the next operation of the request in progress on
+                the given unit. Called from the interrupt path once the
+                previous operation has finished.
+    Returns: 1 if an operation was issued, 0 if the request is done
+ ------------------------------------------------------------------------*/
+static int
+diskNextOp(int unit)
+{
+    diskUnit *d = &diskUnits[unit];
+    diskReq *req = d->req;
+
+    if (!d->seeking) { // a sector was just read/written
+        req->sectors--;
+        req->request.reg2 += USLOSS_DISK_SECTOR_SIZE;
+        if (req->sectors == 0)
+            return 0;
+
+        // request first sector of next track
+        d->sector++;
+        if (d->sector == USLOSS_DISK_TRACK_SIZE) {
+            d->track++;
+            d->sector = 0;
+            diskSeek(unit);
+            return 1;
+        }
+    }
+
+    // read/write the next sector
+    d->seeking = 0;
+    d->stats.ops++;
+    req->request.reg1 = (void *) ((long) d->sector);
+    USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &req->request);
+    return 1;
+}
+
 /* Terminal Driver */
 static int
 TermDriver(char *arg)
@@ -383,22 +620,12 @@ TermDriver(char *arg)
             return 0;
         }
 
-        // Try to receive character
-        int recv = USLOSS_TERM_STAT_RECV(status);
-        if (recv == USLOSS_DEV_BUSY) {
-            MboxCondSend(charRecvMbox[unit], &status, sizeof(int));
-        }
-        else if (recv == USLOSS_DEV_ERROR) {
+        // characters are received and sent by termIntHandler
+        if (USLOSS_TERM_STAT_RECV(status) == USLOSS_DEV_ERROR) {
             if (debug4) 
                 USLOSS_Console("TermDriver RECV ERROR\n");
         }
-
-        // Try to send character
-        int xmit = USLOSS_TERM_STAT_XMIT(status);
-        if (xmit == USLOSS_DEV_READY) {
-            MboxCondSend(charSendMbox[unit], &status, sizeof(int));
-        }
-        else if (xmit == USLOSS_DEV_ERROR) {
+        if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_ERROR) {
             if (debug4) 
                 USLOSS_Console("TermDriver XMIT ERROR\n");
         }
@@ -412,35 +639,35 @@ static int
 TermReader(char * arg) 
 {
     int unit = atoi( (char *) arg);     // Unit is passed as arg.
-    int i;
     int receive; // char to receive
-    char line[MAXLINE]; // line being created/read
+    char line[TERM_MAX_LINE]; // line being created/read
     int next = 0; // index in line to write char
-
-    for (i = 0; i < MAXLINE; i++) { 
-        line[i] = '\0';
-    }
+    termLine msg; // the line, passed to termReadReal
 
     semvReal(running);
     while (!isZapped()) {
         // receieve characters
-        MboxReceive(charRecvMbox[unit], &receive, sizeof(int));
-        char ch = USLOSS_TERM_STAT_CHAR(receive);
+        receive = termGetc(unit);
+        if (receive < 0) // zapped
+            break;
+        char ch = receive;
         line[next] = ch;
         next++;
 
         // receive line
-        if (ch == '\n' || next == MAXLINE) {
+        if (ch == '\n' || next >= termIns[unit].config.lineSize) {
             if (debug4) 
                 USLOSS_Console("TermReader (unit %d): line send\n", unit);
 
-            line[next] = '\0'; // end with null
-            MboxSend(lineReadMbox[unit], line, next);
+            // lines can be longer than a mailbox slot, so pass a copy
+            msg.len = next;
+            msg.data = malloc(next);
+            memcpy(msg.data, line, next);
+            MboxSend(lineReadMbox[unit], &msg, sizeof(msg));
+            termLines[unit]++;
+            termPollWake();
 
             // reset line
-            for (i = 0; i < MAXLINE; i++) {
-                line[i] = '\0';
-            } 
             next = 0;
         }
 
@@ -449,69 +676,6 @@ TermReader(char * arg)
     return 0;
 }
 
-/* Terminal Writer */
-static int 
-TermWriter(char * arg) 
-{
-    int unit = atoi( (char *) arg);     // Unit is passed as arg.
-    int size;
-    int ctrl = 0;
-    int next;
-    int status;
-    char line[MAXLINE];
-
-    semvReal(running);
-    if (debug4) 
-        USLOSS_Console("TermWriter (unit %d): running\n", unit);
-
-    while (!isZapped()) {
-        size = MboxReceive(lineWriteMbox[unit], line, MAXLINE); // get line and size
-
-        if (isZapped())
-            break;
-
-        // enable xmit interrupt and receive interrupt
-        ctrl = USLOSS_TERM_CTRL_XMIT_INT(ctrl);
-        USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *) ((long) ctrl));
-
-        // xmit the line
-        next = 0;
-        while (next < size) {
-            MboxReceive(charSendMbox[unit], &status, sizeof(int));
-
-            // xmit the character
-            int x = USLOSS_TERM_STAT_XMIT(status);
-            if (x == USLOSS_DEV_READY) {
-                //USLOSS_Console("%c string %d unit\n", line[next], unit);
-
-                ctrl = 0;
-                //ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
-                ctrl = USLOSS_TERM_CTRL_CHAR(ctrl, line[next]);
-                ctrl = USLOSS_TERM_CTRL_XMIT_CHAR(ctrl);
-                ctrl = USLOSS_TERM_CTRL_XMIT_INT(ctrl);
-
-                USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *) ((long) ctrl));
-            }
-
-            next++;
-        }
-
-        // enable receive interrupt
-        ctrl = 0;
-        if (termInt[unit] == 1) 
-            ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
-        USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *) ((long) ctrl));
-        termInt[unit] = 0;
-        int pid; 
-        MboxReceive(pidMbox[unit], &pid, sizeof(int));
-        semvReal(ProcTable[pid % MAXPROC].blockSem);
-        
-        
-    }
-
-    return 0;
-}
-
 /* sleep function value extraction */
 void sleep(systemArgs * args) {
     requireKernelMode("sleep");
@@ -528,7 +692,34 @@ int sleepReal(int seconds) {
     if (debug4) 
         USLOSS_Console("sleepReal: called for process %d with %d seconds\n", getpid(), seconds);
 
-    if (seconds < 0) {
+    // the wait is kept in microseconds, so longer sleeps would overflow
+    if (seconds < 0 || seconds > INT_MAX / 1000000) {
+        return -1;
+    }
+
+    return sleepUsReal(seconds*1000000);
+}
+
+/* extract values from sysargs and call sleepUsReal */
+void sleepUs(systemArgs * args) {
+    requireKernelMode("sleepUs");
+    int us = (long) args->arg1;
+    int retval = sleepUsReal(us);
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
+
+/*------------------------------------------------------------------------
+    sleepUsReal: Blocks the calling process for the given number of
+        microseconds. Its timer is checked on every clock interrupt and
+        on disk interrupts in between, so it wakes at the first
+        interrupt after its deadline.
+    Returns: -1 if given illegal input, 0 otherwise
+ ------------------------------------------------------------------------*/
+int sleepUsReal(int us) {
+    requireKernelMode("sleepUsReal");
+
+    if (us < 0) {
         return -1;
     }
 
@@ -537,18 +728,17 @@ int sleepReal(int seconds) {
         initProc(getpid());
     }
     procPtr proc = &ProcTable[getpid() % MAXPROC];
+    MboxCondReceive(proc->mboxID, NULL, 0); // clear an old wakeup
     
     // set wake time
-    proc->wakeTime = USLOSS_Clock() + seconds*1000000;
-    if (debug4) 
-        USLOSS_Console("sleepReal: set wake time for process %d to %d, adding to heap...\n", proc->pid, proc->wakeTime);
-
-    heapAdd(&sleepHeap, proc); // add to sleep heap
+    proc->sleepTimer.func = timerWakeProc;
+    proc->sleepTimer.arg = proc;
+    timerAdd(&proc->sleepTimer, us);
     if (debug4) 
-        USLOSS_Console("sleepReal: Process %d going to sleep until %d\n", proc->pid, proc->wakeTime);
-    sempReal(proc->blockSem); // block the process
+        USLOSS_Console("sleepUsReal: Process %d going to sleep until %d\n", proc->pid, proc->sleepTimer.deadline);
+    MboxReceive(proc->mboxID, NULL, 0); // block the process
     if (debug4) 
-        USLOSS_Console("sleepReal: Process %d woke up, time is %d\n", proc->pid, USLOSS_Clock());
+        USLOSS_Console("sleepUsReal: Process %d woke up, time is %d\n", proc->pid, USLOSS_Clock());
     return 0;
 }
 
@@ -614,43 +804,173 @@ int diskReadOrWriteReal(int unit, int track, int first, int sectors, void *buffe
         USLOSS_Console("diskReadOrWriteReal: called with unit: %d, track: %d, first: %d, sectors: %d, write: %d\n", unit, track, first, sectors, write);
 
     // check for illegal args
-    if (unit < 0 || unit > 1 || track < 0 || track > ProcTable[diskPids[unit]].diskTrack ||
-        first < 0 || first > USLOSS_DISK_TRACK_SIZE || buffer == NULL  ||
-        (first + sectors)/USLOSS_DISK_TRACK_SIZE + track > ProcTable[diskPids[unit]].diskTrack) {
+    if (!diskValidArgs(unit, track, first, sectors) || buffer == NULL) {
         return -1;
     }
 
-    procPtr driver = &ProcTable[diskPids[unit]];
+    // committed transactions have to reach the disk first
+    journalSync();
 
+    return diskIO(unit, track, first, sectors, buffer, write);
+}
+
+/* Returns 1 if the sectors given are on the given unit, 0 otherwise */
+static int diskValidArgs(int unit, int track, int first, int sectors) {
+    if (unit < 0 || unit > DISK_STRIPED || track < 0 || track >= diskTracks(unit) ||
+        first < 0 || first > USLOSS_DISK_TRACK_SIZE ||
+        (first + sectors)/USLOSS_DISK_TRACK_SIZE + track > diskTracks(unit)) {
+        return 0;
+    }
+    return 1;
+}
+
+/* Reads or writes the given sectors, blocking until done. The arguments
+ * are not checked, so the journal can use its tracks. */
+static int diskIO(int unit, int track, int first, int sectors, void *buffer, int write) {
     // init/get the process
     if (ProcTable[getpid() % MAXPROC].pid == -1) {
         initProc(getpid());
     }
     procPtr proc = &ProcTable[getpid() % MAXPROC];
 
-    if (write)
-        proc->diskRequest.opr = USLOSS_DISK_WRITE;
-    else
-        proc->diskRequest.opr = USLOSS_DISK_READ;
-    proc->diskRequest.reg2 = buffer;
-    proc->diskTrack = track;
-    proc->diskFirstSec = first;
-    proc->diskSectors = sectors;
-    proc->diskBuffer = buffer;
-
-    addDiskQ(&diskQs[unit], proc); // add to disk queue 
-    semvReal(driver->blockSem);  // wake up disk driver
+    if (unit == DISK_STRIPED)
+        return diskStripedReal(proc, track, first, sectors, buffer, write);
+
+    diskSubmit(proc, unit, track, first, sectors, buffer, write);
     sempReal(proc->blockSem); // block
 
     int status;
     int result = USLOSS_DeviceInput(USLOSS_DISK_DEV, unit, &status);
 
     if (debug4)
-        USLOSS_Console("diskReadOrWriteReal: finished, status = %d, result = %d\n", status, result);
+        USLOSS_Console("diskIO: finished, status = %d, result = %d\n", status, result);
 
     return result;
 }
 
+/* Fills in the process's request for the given unit, adds it to the
+ * unit's queue and wakes up the unit's driver */
+static void diskSubmit(procPtr proc, int unit, int track, int first, int sectors, void *buffer, int write) {
+    diskReq *req = &proc->diskReqs[unit];
+
+    if (write)
+        req->request.opr = USLOSS_DISK_WRITE;
+    else
+        req->request.opr = USLOSS_DISK_READ;
+    req->request.reg2 = buffer;
+    req->track = track;
+    req->firstSec = first;
+    req->sectors = sectors;
+
+    addDiskQ(&diskQs[unit], req); // add to disk queue 
+    semvReal(ProcTable[diskPids[unit]].blockSem);  // wake up disk driver
+}
+
+/*------------------------------------------------------------------------
+    diskStripedReal: Reads or writes sectors of the striped unit. Logical
+        sector l is in stripe l/diskStripeSectors, and the stripes
+        alternate between units 0 and 1. The sectors a request needs from
+        a unit are contiguous on that unit, so each unit gets a single
+        request through a bounce buffer and both units work at once.
+    Returns: the result of USLOSS_DeviceInput for the units, ORed
+ ------------------------------------------------------------------------*/
+static int diskStripedReal(procPtr proc, int track, int first, int sectors, char *buffer, int write) {
+    int logical = track * USLOSS_DISK_TRACK_SIZE + first;
+    int start[USLOSS_DISK_UNITS];
+    int count[USLOSS_DISK_UNITS];
+    char *bounce[USLOSS_DISK_UNITS];
+    int l, n, unit, status;
+    int result = USLOSS_DEV_OK;
+
+    diskStripedUsed = 1; // DiskStripe can't move the data any more
+
+    // find the physical sectors covered on each unit
+    for (unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+        count[unit] = 0;
+        bounce[unit] = NULL;
+    }
+    for (l = logical; l < logical + sectors; l += n) {
+        int stripe = l / diskStripeSectors;
+        unit = stripe % USLOSS_DISK_UNITS;
+        n = diskStripeSectors - l % diskStripeSectors;
+        if (n > logical + sectors - l)
+            n = logical + sectors - l;
+        if (count[unit] == 0)
+            start[unit] = (stripe / USLOSS_DISK_UNITS) * diskStripeSectors + l % diskStripeSectors;
+        count[unit] += n;
+    }
+
+    for (unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+        if (count[unit] > 0)
+            bounce[unit] = malloc(count[unit] * USLOSS_DISK_SECTOR_SIZE);
+    }
+    if (write)
+        diskStripeCopy(logical, sectors, buffer, bounce, 1);
+
+    // start the units on their parts, then wait for both
+    for (unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+        if (count[unit] > 0)
+            diskSubmit(proc, unit, start[unit] / USLOSS_DISK_TRACK_SIZE,
+                start[unit] % USLOSS_DISK_TRACK_SIZE, count[unit], bounce[unit], write);
+    }
+    for (unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+        if (count[unit] > 0) {
+            sempReal(proc->blockSem);
+        }
+    }
+
+    if (!write)
+        diskStripeCopy(logical, sectors, buffer, bounce, 0);
+
+    for (unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+        if (count[unit] > 0)
+            result |= USLOSS_DeviceInput(USLOSS_DISK_DEV, unit, &status);
+        free(bounce[unit]);
+    }
+
+    if (debug4)
+        USLOSS_Console("diskStripedReal: finished, unit 0 sectors = %d, unit 1 sectors = %d, result = %d\n", count[0], count[1], result);
+
+    return result;
+}
+
+/* Copies the given logical sectors between the caller's buffer and the
+ * units' bounce buffers, into the bounce buffers if toBounce is set */
+static void diskStripeCopy(int logical, int sectors, char *buffer, char **bounce, int toBounce) {
+    int offset[USLOSS_DISK_UNITS] = {0};
+    int l, n;
+
+    for (l = logical; l < logical + sectors; l += n) {
+        int unit = (l / diskStripeSectors) % USLOSS_DISK_UNITS;
+        n = diskStripeSectors - l % diskStripeSectors;
+        if (n > logical + sectors - l)
+            n = logical + sectors - l;
+
+        char *b = bounce[unit] + offset[unit];
+        if (toBounce)
+            memcpy(b, buffer, n * USLOSS_DISK_SECTOR_SIZE);
+        else
+            memcpy(buffer, b, n * USLOSS_DISK_SECTOR_SIZE);
+        buffer += n * USLOSS_DISK_SECTOR_SIZE;
+        offset[unit] += n * USLOSS_DISK_SECTOR_SIZE;
+    }
+}
+
+/* Returns the number of tracks on the given unit, including the striped unit */
+static int diskTracks(int unit) {
+    if (unit == JOURNAL_UNIT)
+        return diskUnits[unit].tracks - diskJournal.tracks;
+    if (unit != DISK_STRIPED)
+        return diskUnits[unit].tracks;
+
+    // whole stripes on the smaller unit, on both units
+    int tracks = diskTracks(0);
+    if (diskTracks(1) < tracks)
+        tracks = diskTracks(1);
+    int stripes = tracks * USLOSS_DISK_TRACK_SIZE / diskStripeSectors;
+    return USLOSS_DISK_UNITS * stripes * diskStripeSectors / USLOSS_DISK_TRACK_SIZE;
+}
+
 /* extract values from sysargs and call diskSizeReal */
 void diskSize(systemArgs * args) {
     requireKernelMode("diskSize");
@@ -674,43 +994,119 @@ int diskSizeReal(int unit, int *sector, int *track, int *disk) {
     requireKernelMode("diskSizeReal");
 
     // check for illegal args
-    if (unit < 0 || unit > 1 || sector == NULL || track == NULL || disk == NULL) {
+    if (unit < 0 || unit > DISK_STRIPED || sector == NULL || track == NULL || disk == NULL) {
         if (debug4)
             USLOSS_Console("diskSizeReal: given illegal argument(s), returning -1\n");
         return -1;
     }
 
-    procPtr driver = &ProcTable[diskPids[unit]];
+    // the striped unit's size depends on the stripe size, so it is fixed
+    // once someone has seen it
+    if (unit == DISK_STRIPED)
+        diskStripedUsed = 1;
 
-    // get the number of tracks for the first time
-    if (driver->diskTrack == -1) {
-        // init/get the process
-        if (ProcTable[getpid() % MAXPROC].pid == -1) {
-            initProc(getpid());
-        }
-        procPtr proc = &ProcTable[getpid() % MAXPROC];
+    // the drivers get the number of tracks when they start
+    *sector = USLOSS_DISK_SECTOR_SIZE;
+    *track = USLOSS_DISK_TRACK_SIZE;
+    *disk = diskTracks(unit);
+    return 0;
+}
 
-        // set variables
-        proc->diskTrack = 0;
-        USLOSS_DeviceRequest request;
-        request.opr = USLOSS_DISK_TRACKS;
-        request.reg1 = &driver->diskTrack;
-        proc->diskRequest = request;
+/* extract values from sysargs and call diskStripeReal */
+void diskStripe(systemArgs * args) {
+    requireKernelMode("diskStripe");
+    int sectors = (long) args->arg1;
+    int retval = diskStripeReal(sectors);
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
 
-        addDiskQ(&diskQs[unit], proc); // add to disk queue 
-        semvReal(driver->blockSem);  // wake up disk driver
-        sempReal(proc->blockSem); // block
+/*------------------------------------------------------------------------
+    diskStripeReal: Sets the stripe size of the striped unit, in sectors.
+        Stripes are whole divisors of a track, and the size can't change
+        once the unit has been used, since that would move its data.
+    Returns: -1 if given illegal input, -2 if the striped unit has been
+        used, 0 otherwise
+ ------------------------------------------------------------------------*/
+int diskStripeReal(int sectors) {
+    requireKernelMode("diskStripeReal");
 
-        if (debug4)
-            USLOSS_Console("diskSizeReal: number of tracks on unit %d: %d\n", unit, driver->diskTrack);
+    if (sectors < 1 || sectors > USLOSS_DISK_TRACK_SIZE || USLOSS_DISK_TRACK_SIZE % sectors != 0) {
+        return -1;
     }
+    if (diskStripedUsed) {
+        return -2;
+    }
+    diskStripeSectors = sectors;
+    return 0;
+}
 
-    *sector = USLOSS_DISK_SECTOR_SIZE;
-    *track = USLOSS_DISK_TRACK_SIZE;
-    *disk = driver->diskTrack;
+/* extract values from sysargs and call diskStatsReal */
+void diskStats(systemArgs * args) {
+    requireKernelMode("diskStats");
+    int unit = (long) args->arg1;
+    int retval = diskStatsReal(unit, (DiskStat *) args->arg2);
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
+
+/*------------------------------------------------------------------------
+    diskStatsReal: Copies the statistics kept for the given unit into
+                   stats.
+    Returns: -1 if given illegal input, 0 otherwise
+ ------------------------------------------------------------------------*/
+int diskStatsReal(int unit, DiskStat *stats) {
+    requireKernelMode("diskStatsReal");
+
+    if (unit < 0 || unit > 1 || stats == NULL) {
+        return -1;
+    }
+
+    memcpy(stats, &diskUnits[unit].stats, sizeof(DiskStat));
     return 0;
 }
 
+/* Print the statistics for the given disk unit, if it was ever used */
+void printDiskStats(int unit) {
+    DiskStat *stats = &diskUnits[unit].stats;
+    int i;
+
+    if (stats->requests == 0)
+        return;
+
+    USLOSS_Console("DiskStats unit %d\n", unit);
+    USLOSS_Console("requests:       %d\n", stats->requests);
+    USLOSS_Console("sectors:        %d\n", stats->sectors);
+    USLOSS_Console("seeks:          %d\n", stats->seeks);
+    USLOSS_Console("seekDistance:   %d\n", stats->seekDistance);
+    USLOSS_Console("maxQueueDepth:  %d\n", stats->maxQueueDepth);
+    USLOSS_Console("avgQueueDepth:  %d\n", stats->queueDepthSum / stats->requests);
+    USLOSS_Console("avgQueueTime:   %d us\n", stats->queueTime / stats->requests);
+    USLOSS_Console("avgServiceTime: %d us\n", stats->serviceTime / stats->requests);
+    USLOSS_Console("ops/wakeups:    %d/%d\n", stats->ops, stats->wakeups);
+    USLOSS_Console("%-14s%10s%10s\n", "latency (ms)", "queued", "service");
+    for (i = 0; i < DISK_HIST_BUCKETS; i++) {
+        if (stats->queueHist[i] == 0 && stats->serviceHist[i] == 0)
+            continue;
+        if (i == 0)
+            USLOSS_Console("%-14s%10d%10d\n", "< 1", stats->queueHist[i], stats->serviceHist[i]);
+        else
+            USLOSS_Console("%5d - %-6d%10d%10d\n", 1 << (i-1), 1 << i, stats->queueHist[i], stats->serviceHist[i]);
+    }
+}
+
+/* Returns the histogram bucket for a latency given in microseconds */
+static int diskHistBucket(int us) {
+    int bucket = 0;
+    int ms = us / 1000;
+
+    while (ms > 0 && bucket < DISK_HIST_BUCKETS - 1) {
+        ms >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
 void termRead(systemArgs * args) {
     if (debug4)
         USLOSS_Console("termRead\n");
@@ -719,8 +1115,9 @@ void termRead(systemArgs * args) {
     char *buffer = (char *) args->arg1;
     int size = (long) args->arg2;
     int unit = (long) args->arg3;
+    int nonblock = (long) args->arg4;
 
-    long retval = termReadReal(unit, size, buffer);
+    long retval = termReadLine(unit, size, buffer, nonblock);
 
     if (retval == -1) {
         args->arg2 = (void *) ((long) retval);
@@ -733,6 +1130,18 @@ void termRead(systemArgs * args) {
 }
 
 int termReadReal(int unit, int size, char *buffer) {
+    return termReadLine(unit, size, buffer, 0);
+}
+
+/*------------------------------------------------------------------------
+    termReadLine: Reads the next line from the given terminal into buffer,
+        truncated to size. If nonblock is set and no line has come in yet,
+        returns 0 instead of waiting. In raw mode reads bytes instead, see
+        termReadRaw.
+    Returns: -1 if given illegal input, the number of characters read
+             otherwise
+ ------------------------------------------------------------------------*/
+static int termReadLine(int unit, int size, char *buffer, int nonblock) {
     if (debug4)
         USLOSS_Console("termReadReal\n");
     requireKernelMode("termReadReal");
@@ -740,18 +1149,31 @@ int termReadReal(int unit, int size, char *buffer) {
     if (unit < 0 || unit > USLOSS_TERM_UNITS - 1 || size < 0) {
         return -1;
     }
-    char line[MAXLINE];
-    int ctrl = 0;
+    termLine line;
 
     //enable term interrupts
     if (termInt[unit] == 0) {
         if (debug4)
             USLOSS_Console("termReadReal enable interrupts\n");
-        ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
-        USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *) ((long) ctrl));
+        int psr = USLOSS_PsrGet();
+        USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
         termInt[unit] = 1;
+        termSetCtrl(unit);
+        USLOSS_PsrSet(psr);
+    }
+    if (termIns[unit].config.raw)
+        return termReadRaw(unit, size, buffer, nonblock);
+
+    int retval;
+    if (nonblock) {
+        retval = MboxCondReceive(lineReadMbox[unit], &line, sizeof(line));
+        if (retval < 0)
+            return 0;
     }
-    int retval = MboxReceive(lineReadMbox[unit], &line, MAXLINE);
+    else
+        MboxReceive(lineReadMbox[unit], &line, sizeof(line));
+    termLines[unit]--;
+    retval = line.len;
 
     if (debug4) 
         USLOSS_Console("termReadReal (unit %d): size %d retval %d \n", unit, size, retval);
@@ -759,11 +1181,157 @@ int termReadReal(int unit, int size, char *buffer) {
     if (retval > size) {
         retval = size;
     }
-    memcpy(buffer, line, retval);
+    memcpy(buffer, line.data, retval);
+    free(line.data);
 
     return retval;
 }
 
+/*------------------------------------------------------------------------
+    termReadRaw: Reads up to size bytes straight from the unit's input
+        ring, as POSIX does in non-canonical mode. Waits for vmin bytes
+        (at most size); if vtime is set, gives up once vtime ms go by
+        without a byte after the first one, or with vmin 0, without the
+        first byte. With nonblock, or vmin and vtime both 0, only takes
+        what has already come in.
+    Returns: the number of bytes read
+ ------------------------------------------------------------------------*/
+static int termReadRaw(int unit, int size, char *buffer, int nonblock) {
+    termIn *t = &termIns[unit];
+    int vmin = t->config.vmin;
+    int vtime = t->config.vtime * 1000;
+    int count = 0;
+    int psr = USLOSS_PsrGet();
+
+    if (vmin > size)
+        vmin = size;
+
+    sempReal(t->readSem);
+    t->timedOut = 0;
+    if (vmin == 0 && vtime > 0 && !nonblock)
+        timerAdd(&t->vtimer, vtime);
+
+    while (count < size) {
+        if (t->head != t->tail) {
+            buffer[count++] = t->buf[t->head];
+            t->head = (t->head + 1) % t->size;
+            if (vmin > 0 && vtime > 0) {
+                t->timedOut = 0;
+                timerAdd(&t->vtimer, vtime); // restart the inter-byte timer
+            }
+            continue;
+        }
+
+        if (nonblock || t->timedOut)
+            break;
+        if (vmin == 0 && (count > 0 || vtime == 0))
+            break;
+        if (vmin > 0 && count >= vmin)
+            break;
+
+        // the interrupt only wakes us if it sees waiting set
+        USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+        t->waiting = 1;
+        if (t->head == t->tail && !t->timedOut) {
+            USLOSS_PsrSet(psr);
+            MboxReceive(t->dataMbox, NULL, 0);
+        }
+        t->waiting = 0;
+        USLOSS_PsrSet(psr);
+    }
+
+    timerCancel(&t->vtimer);
+    semvReal(t->readSem);
+
+    if (debug4)
+        USLOSS_Console("termReadRaw (unit %d): size %d read %d\n", unit, size, count);
+
+    return count;
+}
+
+/* Timer function for a raw read's VTIME, wakes the reader */
+static void termVtimeExpired(timer *tm) {
+    termIn *t = tm->arg;
+
+    t->timedOut = 1;
+    MboxCondSend(t->dataMbox, NULL, 0);
+}
+
+/* extract values from sysargs and call termIoctlReal */
+void termIoctl(systemArgs * args) {
+    requireKernelMode("termIoctl");
+    int unit = (long) args->arg1;
+    int request = (long) args->arg2;
+    TermConfig *config = (TermConfig *) args->arg3;
+    int retval = termIoctlReal(unit, request, config);
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
+
+/*------------------------------------------------------------------------
+    termIoctlReal: Gets or sets the settings of the given terminal. The
+        input ring can only be resized while it is empty. Lines already
+        read stay queued while the unit is in raw mode, and TermReader
+        picks up where it left off when raw mode is turned off.
+    Returns: -1 if given illegal input or the ring is not empty when
+             resizing, 0 otherwise
+ ------------------------------------------------------------------------*/
+int termIoctlReal(int unit, int request, TermConfig *config) {
+    requireKernelMode("termIoctlReal");
+
+    if (unit < 0 || unit > USLOSS_TERM_UNITS - 1 || config == NULL)
+        return -1;
+
+    termIn *t = &termIns[unit];
+
+    if (request == TERM_GETCONFIG) {
+        *config = t->config;
+        return 0;
+    }
+    if (request != TERM_SETCONFIG)
+        return -1;
+    if (config->vmin < 0 || config->vmin > TERM_MAX_LINE || config->vtime < 0 ||
+        config->lineSize < 1 || config->lineSize > TERM_MAX_LINE ||
+        config->bufSize < 2 || config->bufSize > TERM_MAX_BUF)
+        return -1;
+
+    int psr = USLOSS_PsrGet();
+    int wasRaw = t->config.raw;
+
+    sempReal(t->readSem); // no raw reads while the settings change
+    if (config->bufSize != t->size) {
+        char *buf = malloc(config->bufSize);
+        USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+        if (t->head != t->tail) {
+            USLOSS_PsrSet(psr);
+            semvReal(t->readSem);
+            free(buf);
+            return -1;
+        }
+        free(t->buf);
+        t->buf = buf;
+        t->size = config->bufSize;
+        t->head = 0;
+        t->tail = 0;
+        USLOSS_PsrSet(psr);
+    }
+    t->config = *config;
+    t->config.raw = config->raw != 0;
+
+    // move TermReader off dataMbox, or let it go back to reading lines
+    if (t->config.raw && !wasRaw)
+        MboxCondSend(t->dataMbox, NULL, 0);
+    if (!t->config.raw && wasRaw)
+        MboxCondSend(t->modeMbox, NULL, 0);
+    semvReal(t->readSem);
+
+    if (debug4)
+        USLOSS_Console("termIoctlReal (unit %d): raw %d vmin %d vtime %d line %d buf %d\n", unit,
+            t->config.raw, t->config.vmin, t->config.vtime, t->config.lineSize, t->size);
+
+    return 0;
+}
+
 void termWrite(systemArgs * args) {
     if (debug4)
         USLOSS_Console("termWrite\n");
@@ -785,23 +1353,328 @@ void termWrite(systemArgs * args) {
     setUserMode(); 
 }
 
-int termWriteReal(int unit, int size, char *text) {
-    if (debug4)
+/* extract values from sysargs and call termPollReal */
+void termPoll(systemArgs * args) {
+    requireKernelMode("termPoll");
+    PollFd *fds = (PollFd *) args->arg1;
+    int nfds = (long) args->arg2;
+    int timeout = (long) args->arg3;
+    int retval = termPollReal(fds, nfds, timeout);
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
+
+/*------------------------------------------------------------------------
+    termPollReal: Waits until one of the given terminal units has a line
+        (in raw mode, a byte) waiting or one of the given mailboxes has a message, or timeout
+        milliseconds go by. TermReader wakes the poller when a line comes
+        in; mailboxes can't tell us about messages, so while any are
+        polled they are checked again on every clock tick.
+    Returns: -1 if given illegal input, the number of ready entries
+             otherwise (0 on timeout)
+ ------------------------------------------------------------------------*/
+int termPollReal(PollFd *fds, int nfds, int timeout) {
+    requireKernelMode("termPollReal");
+
+    int i, ready;
+    int mboxes = 0;
+    int deadline = USLOSS_Clock() + timeout * 1000;
+
+    if (fds == NULL || nfds <= 0 || nfds > POLL_MAX) {
+        return -1;
+    }
+    for (i = 0; i < nfds; i++) {
+        if (fds[i].type == POLL_TERM && (fds[i].id < 0 || fds[i].id >= USLOSS_TERM_UNITS))
+            return -1;
+        if (fds[i].type != POLL_TERM && fds[i].type != POLL_MBOX)
+            return -1;
+        if (fds[i].type == POLL_MBOX)
+            mboxes++;
+    }
+
+    // init/get the process
+    if (ProcTable[getpid() % MAXPROC].pid == -1) {
+        initProc(getpid());
+    }
+    procPtr proc = &ProcTable[getpid() % MAXPROC];
+
+    // lines only come in once receive interrupts are on
+    for (i = 0; i < nfds; i++) {
+        int unit = fds[i].id;
+        if (fds[i].type == POLL_TERM && termInt[unit] == 0) {
+            int psr = USLOSS_PsrGet();
+            USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+            termInt[unit] = 1;
+            termSetCtrl(unit);
+            USLOSS_PsrSet(psr);
+        }
+    }
+
+    MboxCondReceive(proc->mboxID, NULL, 0); // clear an old wakeup
+    proc->sleepTimer.func = timerWakeProc;
+    proc->sleepTimer.arg = proc;
+    pollWaiters++;
+    while (1) {
+        // wakeups from here on are kept in the mailbox
+        proc->polling = 1;
+        ready = termPollCheck(fds, nfds);
+        if (ready > 0 || timeout == 0)
+            break;
+
+        int wait = -1;
+        if (timeout > 0) {
+            wait = deadline - USLOSS_Clock();
+            if (wait <= 0)
+                break;
+        }
+        if (mboxes > 0 && (wait < 0 || wait > TIMER_TICK_US))
+            wait = TIMER_TICK_US;
+        if (wait > 0)
+            timerAdd(&proc->sleepTimer, wait);
+
+        MboxReceive(proc->mboxID, NULL, 0);
+        timerCancel(&proc->sleepTimer);
+    }
+    proc->polling = 0;
+    pollWaiters--;
+
+    if (debug4)
+        USLOSS_Console("termPollReal: pid %d, %d entries ready\n", proc->pid, ready);
+
+    return ready;
+}
+
+/* Marks the entries that are ready, receiving the messages for mailbox
+ * entries, and returns how many are */
+static int termPollCheck(PollFd *fds, int nfds) {
+    int i;
+    int ready = 0;
+
+    for (i = 0; i < nfds; i++) {
+        fds[i].ready = 0;
+        if (fds[i].type == POLL_TERM) {
+            termIn *t = &termIns[fds[i].id];
+            if (t->config.raw)
+                fds[i].ready = t->head != t->tail;
+            else
+                fds[i].ready = termLines[fds[i].id] > 0;
+        }
+        else {
+            int result = MboxCondReceive(fds[i].id, fds[i].buf, fds[i].size);
+            if (result >= 0) {
+                fds[i].ready = 1;
+                fds[i].result = result;
+            }
+        }
+        ready += fds[i].ready;
+    }
+    return ready;
+}
+
+/* Wakes up the processes waiting in TermPoll so they check again */
+static void termPollWake(void) {
+    int i;
+
+    for (i = 0; pollWaiters > 0 && i < MAXPROC; i++) {
+        if (ProcTable[i].polling)
+            MboxCondSend(ProcTable[i].mboxID, NULL, 0);
+    }
+}
+
+/*------------------------------------------------------------------------
+    termWriteReal: Copies the line into the unit's output ring and starts
+        the transmitter if it is idle. Only waits if the ring is too full
+        for the line; the terminal interrupt sends the characters.
+    Returns: -1 if given illegal input, the number of characters written
+             (at most MAXLINE) otherwise
+ ------------------------------------------------------------------------*/
+int termWriteReal(int unit, int size, char *text) {
+    if (debug4)
         USLOSS_Console("termWriteReal\n");
     requireKernelMode("termWriteReal");
 
     if (unit < 0 || unit > USLOSS_TERM_UNITS - 1 || size < 0) {
         return -1;
     }
+    if (size > MAXLINE)
+        size = MAXLINE;
+
+    termOut *t = &termOuts[unit];
+    int psr = USLOSS_PsrGet();
+    int i;
+
+    sempReal(t->writeSem);
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    // wait for room for the whole line
+    while ((t->head - t->tail - 1 + TERM_OUT_SIZE) % TERM_OUT_SIZE < size) {
+        t->waiting = 1;
+        USLOSS_PsrSet(psr);
+        MboxReceive(t->spaceMbox, NULL, 0);
+        USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    }
+    t->waiting = 0;
+
+    for (i = 0; i < size; i++) {
+        t->buf[t->tail] = text[i];
+        t->tail = (t->tail + 1) % TERM_OUT_SIZE;
+    }
 
-    int pid = getpid();
-    MboxSend(pidMbox[unit], &pid, sizeof(int));
+    // the first transmit interrupt sends the first character
+    if (!t->xmitting && size > 0) {
+        t->xmitting = 1;
+        t->started = USLOSS_Clock();
+        termSetCtrl(unit);
+    }
 
-    MboxSend(lineWriteMbox[unit], text, size);
-    sempReal(ProcTable[pid % MAXPROC].blockSem);
+    USLOSS_PsrSet(psr);
+    semvReal(t->writeSem);
     return size;
 }
 
+/* ------------------------------------------------------------------------
+   Name - termIntHandler
+   Purpose - Terminal interrupt handler. Puts a received character on the
+             unit's input ring and sends the next character of the
+             output ring when the transmitter is ready. Only passes the
+             interrupt on to phase2's handler (waking the TermDriver) on
+             an error, or while the TermDrivers are being zapped.
+   Parameters - the device type and the unit
+   Side Effects - may send a character, may wake the unit's TermReader
+   ------------------------------------------------------------------------ */
+static void termIntHandler(int dev, void *arg) {
+    int unit = (long) arg;
+    int status;
+
+    timerPoll(); // wake sleepers due before the next clock tick
+
+    if (dev == USLOSS_TERM_DEV && unit >= 0 && unit < USLOSS_TERM_UNITS) {
+        USLOSS_DeviceInput(dev, unit, &status);
+        if (USLOSS_TERM_STAT_RECV(status) == USLOSS_DEV_BUSY && !termZapping)
+            termRecv(unit, USLOSS_TERM_STAT_CHAR(status));
+        if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY && termOuts[unit].xmitting)
+            termXmit(unit);
+        if (USLOSS_TERM_STAT_RECV(status) != USLOSS_DEV_ERROR &&
+            USLOSS_TERM_STAT_XMIT(status) != USLOSS_DEV_ERROR && !termZapping)
+            return;
+    }
+
+    phase2TermHandler(dev, arg);
+}
+
+/* Puts a received character on the unit's input ring, counting it as an
+ * overflow if the ring is full */
+static void termRecv(int unit, char ch) {
+    termIn *t = &termIns[unit];
+    int next = (t->tail + 1) % t->size;
+
+    t->chars++;
+    if (next == t->head) {
+        t->overflows++;
+        return;
+    }
+    t->buf[t->tail] = ch;
+    t->tail = next; // the reader can see the character now
+
+    if (t->waiting)
+        MboxCondSend(t->dataMbox, NULL, 0);
+    if (t->config.raw && pollWaiters > 0)
+        termPollWake(); // raw bytes are ready for TermPoll right away
+}
+
+/* Returns the next character from the unit's input ring, waiting for one
+ * if it is empty, or for raw mode to be turned off. Returns -1 if the
+ * reader was zapped while waiting. */
+static int termGetc(int unit) {
+    termIn *t = &termIns[unit];
+
+    while (t->head == t->tail || t->config.raw) {
+        if (isZapped())
+            return -1;
+        if (t->config.raw) {
+            MboxReceive(t->modeMbox, NULL, 0);
+            continue;
+        }
+        t->waiting = 1;
+        if (t->head == t->tail && !t->config.raw)
+            MboxReceive(t->dataMbox, NULL, 0);
+        t->waiting = 0;
+    }
+
+    char ch = t->buf[t->head];
+    t->head = (t->head + 1) % t->size; // frees the slot for the interrupt
+    return (unsigned char) ch;
+}
+
+/* Sends the next character in the unit's output ring, or turns transmit
+ * interrupts off once it is empty */
+static void termXmit(int unit) {
+    termOut *t = &termOuts[unit];
+
+    if (t->head == t->tail) {
+        t->xmitting = 0;
+        t->busyTime += USLOSS_Clock() - t->started;
+        termSetCtrl(unit);
+    }
+    else {
+        int ctrl = 0;
+        if (termInt[unit])
+            ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
+        ctrl = USLOSS_TERM_CTRL_CHAR(ctrl, t->buf[t->head]);
+        ctrl = USLOSS_TERM_CTRL_XMIT_CHAR(ctrl);
+        ctrl = USLOSS_TERM_CTRL_XMIT_INT(ctrl);
+        USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *) ((long) ctrl));
+        t->head = (t->head + 1) % TERM_OUT_SIZE;
+        t->chars++;
+    }
+
+    if (t->waiting)
+        MboxCondSend(t->spaceMbox, NULL, 0);
+}
+
+/* Turns the unit's receive and transmit interrupts on or off to match
+ * termInt and the output ring. Call with interrupts disabled. */
+static void termSetCtrl(int unit) {
+    int ctrl = 0;
+
+    if (termInt[unit])
+        ctrl = USLOSS_TERM_CTRL_RECV_INT(ctrl);
+    if (termOuts[unit].xmitting)
+        ctrl = USLOSS_TERM_CTRL_XMIT_INT(ctrl);
+    USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void *) ((long) ctrl));
+}
+
+/* Waits until everything written to the unit has been sent */
+static void termDrain(int unit) {
+    termOut *t = &termOuts[unit];
+    int psr = USLOSS_PsrGet();
+
+    sempReal(t->writeSem);
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    while (t->xmitting) {
+        t->waiting = 1;
+        USLOSS_PsrSet(psr);
+        MboxReceive(t->spaceMbox, NULL, 0);
+        USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    }
+    t->waiting = 0;
+    USLOSS_PsrSet(psr);
+    semvReal(t->writeSem);
+}
+
+/* Print the statistics for the given terminal, if it was used */
+void printTermStats(int unit) {
+    termOut *t = &termOuts[unit];
+    termIn *in = &termIns[unit];
+
+    if (t->chars == 0 && in->chars == 0)
+        return;
+
+    USLOSS_Console("TermStats unit %d: %d chars sent, %d chars/sec, %d chars received, %d dropped\n", unit,
+        t->chars, t->busyTime > 0 ? (int) (t->chars * 1000000LL / t->busyTime) : 0,
+        in->chars, in->overflows);
+}
+
 /* ------------------------------------------------------------------------
    Name - requireKernelMode
    Purpose - Checks if we are in kernel mode and prints an error messages
@@ -829,19 +1702,568 @@ void setUserMode()
     USLOSS_PsrSet( USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_MODE );
 }
 
+/* ------------------------------------------------------------------------
+  CPU time accounting.
+   ----------------------------------------------------------------------- */
+
+/* ------------------------------------------------------------------------
+   Name - cpuIntHandler
+   Purpose - Installed over every interrupt vector. Runs the handler that
+             was there, charging its time to the kernel for a system call
+             or to interrupts otherwise, then goes back to the mode the
+             process was in.
+   Parameters - the device type and the unit
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static void cpuIntHandler(int dev, void *arg) {
+    int mode = cpuModeEnter(dev == USLOSS_SYSCALL_INT ? CPU_KERNEL : CPU_INTERRUPT);
+
+    cpuHandlers[dev](dev, arg);
+    cpuModeLeave(mode);
+}
+
+/* Charges the current process's time since its last change to the mode
+ * it was in, user mode if the PSR says the handler interrupted user code,
+ * and switches it to the given mode. Returns the mode it was in. */
+static int cpuModeEnter(int mode) {
+    int user = (USLOSS_PsrGet() & USLOSS_PSR_PREV_MODE) == 0;
+    cpuAcct *a = &cpuAccts[getpid() % MAXPROC];
+    int now = USLOSS_Clock();
+    int old = user ? CPU_USER : a->mode;
+
+    a->times[old] += now - a->started;
+    a->started = now;
+    a->mode = mode;
+    return old;
+}
+
+/* Charges the current process's time in a handler, and goes back to the
+ * given mode */
+static void cpuModeLeave(int mode) {
+    cpuAcct *a = &cpuAccts[getpid() % MAXPROC];
+    int now = USLOSS_Clock();
+
+    a->times[a->mode] += now - a->started;
+    a->started = now;
+    a->mode = mode;
+}
+
+/* Called by p1_fork, starts the new process in the kernel with no time */
+void cpuAcctFork(int pid) {
+    cpuAcct *a = &cpuAccts[pid % MAXPROC];
+
+    memset(a, 0, sizeof(cpuAcct));
+    a->pid = pid;
+    a->mode = CPU_KERNEL;
+}
+
+/* Called by p1_switch, charges the process switched out for its time in
+ * its mode and starts the clock for the one switched in */
+void cpuAcctSwitch(int old, int new) {
+    int now = USLOSS_Clock();
+    cpuAcct *a;
+
+    if (old >= 0 && cpuAccts[old % MAXPROC].pid == old) {
+        a = &cpuAccts[old % MAXPROC];
+        a->times[a->mode] += now - a->started;
+    }
+    if (new >= 0)
+        cpuAccts[new % MAXPROC].started = now;
+}
+
+/* Called by p1_quit, the process's times can no longer be read */
+void cpuAcctQuit(int pid) {
+    cpuAccts[pid % MAXPROC].pid = -1;
+}
+
+/* extract values from sysargs and call cpuTimesReal */
+void cpuTimes(systemArgs * args) {
+    requireKernelMode("cpuTimes");
+    int pid = (long) args->arg1;
+    int user = 0, kernel = 0, interrupt = 0;
+
+    int retval = cpuTimesReal(pid, &user, &kernel, &interrupt);
+    args->arg1 = (void *) ((long) user);
+    args->arg2 = (void *) ((long) kernel);
+    args->arg3 = (void *) ((long) interrupt);
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
+
+/*------------------------------------------------------------------------
+    cpuTimesReal: Gets the CPU time (in microseconds) the given process
+        has spent in user code, in system calls and in interrupt handlers.
+    Returns: -1 if there is no process with that pid, 0 otherwise
+ ------------------------------------------------------------------------*/
+int cpuTimesReal(int pid, int *user, int *kernel, int *interrupt) {
+    requireKernelMode("cpuTimesReal");
+
+    int times[CPU_MODES];
+    int i;
+
+    if (pid < 0 || cpuAccts[pid % MAXPROC].pid != pid)
+        return -1;
+
+    cpuAcct *a = &cpuAccts[pid % MAXPROC];
+    for (i = 0; i < CPU_MODES; i++)
+        times[i] = a->times[i];
+    if (pid == getpid())
+        times[a->mode] += USLOSS_Clock() - a->started;
+
+    *user = times[CPU_USER];
+    *kernel = times[CPU_KERNEL];
+    *interrupt = times[CPU_INTERRUPT];
+    return 0;
+}
+
+/* ------------------------------------------------------------------------
+  Journal.
+   ----------------------------------------------------------------------- */
+
+/* Journal Driver */
+static int
+JournalDriver(char *arg)
+{
+    initProc(getpid());
+    diskJournal.mbox = MboxCreate(1, 0);
+    diskJournal.syncSem = semcreateReal(0);
+    diskJournal.idleTimer.func = journalIdle;
+
+    // keep the end of the unit for the journal, if it is big enough,
+    // before anything else can use it
+    if (diskUnits[JOURNAL_UNIT].tracks > JOURNAL_TRACKS) {
+        diskJournal.tracks = JOURNAL_TRACKS;
+        diskJournal.track = diskUnits[JOURNAL_UNIT].tracks - JOURNAL_TRACKS;
+        diskJournal.sectors = JOURNAL_TRACKS * USLOSS_DISK_TRACK_SIZE;
+        diskJournal.log = malloc(diskJournal.sectors * USLOSS_DISK_SECTOR_SIZE);
+        journalReplay();
+    }
+
+    if (debug4) {
+        USLOSS_Console("JournalDriver: started, pid = %d, track = %d, replayed = %d\n", getpid(), diskJournal.track, diskJournal.replayed);
+    }
+
+    // Let the parent know we are running and enable interrupts.
+    semvReal(running);
+    USLOSS_PsrSet(USLOSS_PsrGet() | USLOSS_PSR_CURRENT_INT);
+
+    while (1) {
+        // wakeups that come while the driver is busy are kept in the
+        // mailbox slot, so none is lost
+        MboxReceive(diskJournal.mbox, NULL, 0);
+
+        // the superblock goes out before the first group, so a replay
+        // finds the journal
+        if (diskJournal.pending != NULL && !diskJournal.formatted) {
+            journalSuper *super = (journalSuper *) diskJournal.log;
+            super->magic = JOURNAL_MAGIC;
+            super->seq = diskJournal.seq;
+            journalWrite(0, 1);
+            diskJournal.formatted = 1;
+        }
+
+        // commits that arrived while the last group was written go out
+        // together as the next group
+        int committed = diskJournal.pending != NULL;
+        while (diskJournal.pending != NULL) {
+            if (!journalCommitGroup())
+                journalCheckpoint(); // log is full
+        }
+
+        // installs wait until a direct read or write needs them, commits
+        // stop coming, or the driver quits, so they can cover many groups
+        if (diskJournal.syncWaiters > 0 || (diskJournal.idle && !committed) || isZapped())
+            journalCheckpoint();
+        else if (committed && diskJournal.head > 1) {
+            diskJournal.idle = 0;
+            timerAdd(&diskJournal.idleTimer, JOURNAL_IDLE_US);
+        }
+
+        if (isZapped())
+            return 0;
+    }
+}
+
+/*------------------------------------------------------------------------
+    journalReplay: If the journal has a superblock, installs the groups
+        left in it, in order, then empties it. A group counts only if its
+        sequence number follows the one before it, its checksum matches
+        and its records are valid writes that add up to its data, so a
+        group that was only partly written, or is left over from before
+        the journal was last emptied, ends the replay. A journal nothing
+        was ever committed to is not written to.
+ ------------------------------------------------------------------------*/
+static void journalReplay(void) {
+    journalSuper *super = (journalSuper *) diskJournal.log;
+    int sector = 1;
+
+    diskJournal.seq = 1;
+    diskJournal.head = 1;
+    diskIO(JOURNAL_UNIT, diskJournal.track, 0, 1, diskJournal.log, 0);
+    if (super->magic != JOURNAL_MAGIC)
+        return;
+
+    diskJournal.formatted = 1;
+    diskJournal.seq = super->seq;
+    diskIO(JOURNAL_UNIT, diskJournal.track, 0, diskJournal.sectors, diskJournal.log, 0);
+
+    while (sector < diskJournal.sectors) {
+        journalHeader *h = (journalHeader *) (diskJournal.log + sector * USLOSS_DISK_SECTOR_SIZE);
+        char *data = (char *) h + USLOSS_DISK_SECTOR_SIZE;
+
+        if (h->magic != JOURNAL_MAGIC || h->seq != diskJournal.seq ||
+            h->records < 0 || h->records > JOURNAL_MAX_RECORDS ||
+            h->sectors < 0 || h->sectors > diskJournal.sectors - sector - 1 ||
+            h->checksum != journalChecksum(h) || !journalValid(h))
+            break;
+
+        journalInstall(h, data);
+        sector += 1 + h->sectors;
+        diskJournal.seq++;
+        diskJournal.replayed++;
+    }
+
+    // empty the journal, if anything was installed
+    if (diskJournal.replayed > 0) {
+        super->seq = diskJournal.seq;
+        journalWrite(0, 1);
+    }
+}
+
+/*------------------------------------------------------------------------
+    journalCommitGroup: Appends as many waiting transactions as fit to the
+        log in one write, then wakes up their processes.
+    Returns: 0 if the first waiting transaction does not fit, 1 otherwise
+ ------------------------------------------------------------------------*/
+static int journalCommitGroup(void) {
+    journalHeader *h = (journalHeader *) (diskJournal.log + diskJournal.head * USLOSS_DISK_SECTOR_SIZE);
+    char *data = (char *) h + USLOSS_DISK_SECTOR_SIZE;
+    int space = diskJournal.sectors - diskJournal.head - 1;
+    transaction *tx, *next, *last = NULL;
+
+    memset(h, 0, USLOSS_DISK_SECTOR_SIZE);
+    h->magic = JOURNAL_MAGIC;
+    h->seq = diskJournal.seq;
+    for (tx = diskJournal.pending; tx != NULL; tx = tx->next) {
+        if (h->records + tx->records > JOURNAL_MAX_RECORDS || h->sectors + tx->sectors > space)
+            break;
+        memcpy(&h->rec[h->records], tx->rec, tx->records * sizeof(txRecord));
+        memcpy(data + h->sectors * USLOSS_DISK_SECTOR_SIZE, tx->data, tx->sectors * USLOSS_DISK_SECTOR_SIZE);
+        h->records += tx->records;
+        h->sectors += tx->sectors;
+        last = tx;
+    }
+    if (last == NULL)
+        return 0;
+    h->checksum = journalChecksum(h);
+
+    // take the group off the waiting list
+    transaction *group = diskJournal.pending;
+    diskJournal.pending = last->next;
+    if (diskJournal.pending == NULL)
+        diskJournal.pendingTail = NULL;
+    last->next = NULL;
+
+    int result = journalWrite(diskJournal.head, 1 + h->sectors);
+    if (result == USLOSS_DEV_OK) {
+        diskJournal.head += 1 + h->sectors;
+        diskJournal.seq++;
+        diskJournal.groups++;
+    }
+
+    if (debug4)
+        USLOSS_Console("journalCommitGroup: group %d, records = %d, sectors = %d, result = %d\n", h->seq, h->records, h->sectors, result);
+
+    for (tx = group; tx != NULL; tx = next) {
+        next = tx->next; // tx is freed once its process runs
+        tx->status = (result == USLOSS_DEV_OK) ? 0 : -1;
+        diskJournal.commits++;
+        semvReal(tx->proc->blockSem);
+    }
+    return 1;
+}
+
+/* Installs the groups in the log at their home locations, empties the
+ * log and wakes up any processes waiting for it */
+static void journalCheckpoint(void) {
+    journalSuper *super = (journalSuper *) diskJournal.log;
+    int sector = 1;
+
+    timerCancel(&diskJournal.idleTimer);
+    diskJournal.idle = 0;
+
+    if (diskJournal.head > 1) {
+        while (sector < diskJournal.head) {
+            journalHeader *h = (journalHeader *) (diskJournal.log + sector * USLOSS_DISK_SECTOR_SIZE);
+            journalInstall(h, (char *) h + USLOSS_DISK_SECTOR_SIZE);
+            sector += 1 + h->sectors;
+        }
+
+        // groups up to here are installed
+        super->magic = JOURNAL_MAGIC;
+        super->seq = diskJournal.seq;
+        journalWrite(0, 1);
+        diskJournal.head = 1;
+    }
+
+    while (diskJournal.syncWaiters > 0) {
+        diskJournal.syncWaiters--;
+        semvReal(diskJournal.syncSem);
+    }
+}
+
+/* Writes the data of a group to its home locations */
+static void journalInstall(journalHeader *h, char *data) {
+    int i;
+
+    for (i = 0; i < h->records; i++) {
+        txRecord *r = &h->rec[i];
+        diskIO(r->unit, r->track, r->first, r->sectors, data, 1);
+        data += r->sectors * USLOSS_DISK_SECTOR_SIZE;
+    }
+}
+
+/* Writes the given sectors of the journal from the in-memory copy */
+static int journalWrite(int sector, int sectors) {
+    return diskIO(JOURNAL_UNIT, diskJournal.track + sector / USLOSS_DISK_TRACK_SIZE,
+        sector % USLOSS_DISK_TRACK_SIZE, sectors,
+        diskJournal.log + sector * USLOSS_DISK_SECTOR_SIZE, 1);
+}
+
+/* Returns a checksum of the group, its header sector and data, taken
+ * with the header's checksum 0 */
+static int journalChecksum(journalHeader *h) {
+    unsigned int sum = 0;
+    unsigned int *word = (unsigned int *) h;
+    int checksum = h->checksum;
+    int i;
+
+    h->checksum = 0;
+    for (i = 0; i < (1 + h->sectors) * USLOSS_DISK_SECTOR_SIZE / sizeof(unsigned int); i++)
+        sum = ((sum << 1) | (sum >> 31)) ^ word[i];
+    h->checksum = checksum;
+    return sum;
+}
+
+/* Returns 1 if every record of the group is a write TxWrite would have
+ * taken and the records add up to the group's data sectors, 0 otherwise */
+static int journalValid(journalHeader *h) {
+    int sectors = 0;
+    int i;
+
+    for (i = 0; i < h->records; i++) {
+        txRecord *r = &h->rec[i];
+        if (!diskValidArgs(r->unit, r->track, r->first, r->sectors) ||
+            r->sectors <= 0 || r->sectors > TX_MAX_SECTORS)
+            return 0;
+        sectors += r->sectors;
+    }
+    return sectors == h->sectors;
+}
+
+/* Blocks until the committed transactions have been installed, so direct
+ * reads and writes are ordered after them */
+static void journalSync(void) {
+    if (diskJournal.head > 1 && getpid() != diskJournal.pid) {
+        diskJournal.syncWaiters++;
+        MboxCondSend(diskJournal.mbox, NULL, 0); // wake up journal driver
+        sempReal(diskJournal.syncSem);
+    }
+}
+
+/* Timer function for the journal, wakes the driver to install the log
+ * once commits have stopped */
+static void journalIdle(timer *t) {
+    diskJournal.idle = 1;
+    MboxCondSend(diskJournal.mbox, NULL, 0);
+}
+
+/*------------------------------------------------------------------------
+    txProc: Gets the calling process's entry for a transaction call. There
+        is no hook for a process quitting, so a transaction left open by an
+        earlier process in the same slot is thrown away here.
+    Returns: the calling process's entry
+ ------------------------------------------------------------------------*/
+static procPtr txProc(void) {
+    // init/get the process
+    if (ProcTable[getpid() % MAXPROC].pid == -1) {
+        initProc(getpid());
+    }
+    procPtr proc = &ProcTable[getpid() % MAXPROC];
+
+    if (proc->pid != getpid()) {
+        free(proc->tx);
+        proc->tx = NULL;
+        proc->pid = getpid();
+    }
+    return proc;
+}
+
+/* extract values from sysargs and call txBeginReal */
+void txBegin(systemArgs * args) {
+    requireKernelMode("txBegin");
+    int retval = txBeginReal();
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
+
+/*------------------------------------------------------------------------
+    txBeginReal: Starts a transaction for the calling process.
+    Returns: -1 if it already has one, 0 otherwise
+ ------------------------------------------------------------------------*/
+int txBeginReal(void) {
+    requireKernelMode("txBeginReal");
+
+    procPtr proc = txProc();
+
+    if (proc->tx != NULL)
+        return -1;
+
+    proc->tx = malloc(sizeof(transaction));
+    proc->tx->proc = proc;
+    proc->tx->records = 0;
+    proc->tx->sectors = 0;
+    proc->tx->next = NULL;
+    return 0;
+}
+
+/* extract values from sysargs and call txWriteReal */
+void txWrite(systemArgs * args) {
+    requireKernelMode("txWrite");
+
+    int sectors = (long) args->arg2;
+    int track = (long) args->arg3;
+    int first = (long) args->arg4;
+    int unit = (long) args->arg5;
+
+    int retval = txWriteReal(unit, track, first, sectors, args->arg1);
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
+
+/*------------------------------------------------------------------------
+    txWriteReal: Copies a write into the calling process's transaction.
+    Returns: -1 if given illegal input, there is no transaction or it is
+             full, 0 otherwise
+ ------------------------------------------------------------------------*/
+int txWriteReal(int unit, int track, int first, int sectors, void *buffer) {
+    requireKernelMode("txWriteReal");
+
+    transaction *tx = txProc()->tx;
+
+    if (tx == NULL || !diskValidArgs(unit, track, first, sectors) || buffer == NULL ||
+        sectors <= 0 || tx->records == TX_MAX_WRITES || tx->sectors + sectors > TX_MAX_SECTORS) {
+        return -1;
+    }
+
+    txRecord *r = &tx->rec[tx->records++];
+    r->unit = unit;
+    r->track = track;
+    r->first = first;
+    r->sectors = sectors;
+    memcpy(tx->data + tx->sectors * USLOSS_DISK_SECTOR_SIZE, buffer, sectors * USLOSS_DISK_SECTOR_SIZE);
+    tx->sectors += sectors;
+    return 0;
+}
+
+/* extract values from sysargs and call txCommitReal */
+void txCommit(systemArgs * args) {
+    requireKernelMode("txCommit");
+    int retval = txCommitReal();
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
+
+/*------------------------------------------------------------------------
+    txCommitReal: Hands the calling process's transaction to the journal
+        driver and blocks until it is in the log. Transactions committed
+        while the driver is busy are written together in the next group.
+    Returns: -1 if there is no transaction or it could not be written,
+             0 otherwise
+ ------------------------------------------------------------------------*/
+int txCommitReal(void) {
+    requireKernelMode("txCommitReal");
+
+    procPtr proc = txProc();
+    transaction *tx = proc->tx;
+    int result = 0;
+
+    if (tx == NULL)
+        return -1;
+    proc->tx = NULL;
+
+    if (tx->records > 0 && diskJournal.tracks == 0) {
+        result = -1;
+    }
+    else if (tx->records > 0) {
+        if (diskJournal.pending == NULL)
+            diskJournal.pending = tx;
+        else
+            diskJournal.pendingTail->next = tx;
+        diskJournal.pendingTail = tx;
+
+        MboxCondSend(diskJournal.mbox, NULL, 0); // wake up journal driver
+        sempReal(proc->blockSem); // block
+        result = tx->status;
+    }
+
+    free(tx);
+    return result;
+}
+
+/* extract values from sysargs and call txAbortReal */
+void txAbort(systemArgs * args) {
+    requireKernelMode("txAbort");
+    int retval = txAbortReal();
+    args->arg4 = (void *) ((long) retval);
+    setUserMode();
+}
+
+/*------------------------------------------------------------------------
+    txAbortReal: Throws away the calling process's transaction.
+    Returns: -1 if there is no transaction, 0 otherwise
+ ------------------------------------------------------------------------*/
+int txAbortReal(void) {
+    requireKernelMode("txAbortReal");
+
+    procPtr proc = txProc();
+
+    if (proc->tx == NULL)
+        return -1;
+
+    free(proc->tx);
+    proc->tx = NULL;
+    return 0;
+}
+
+/* Print the journal statistics, if it was ever used */
+void printJournalStats(void) {
+    if (diskJournal.commits == 0 && diskJournal.replayed == 0)
+        return;
+
+    USLOSS_Console("Journal\n");
+    USLOSS_Console("commits:        %d\n", diskJournal.commits);
+    USLOSS_Console("groups:         %d\n", diskJournal.groups);
+    USLOSS_Console("replayed:       %d\n", diskJournal.replayed);
+}
+
 /* initializes proc struct */
 void initProc(int pid) {
     requireKernelMode("initProc()"); 
 
     int i = pid % MAXPROC;
+    int unit;
 
     ProcTable[i].pid = pid; 
-    ProcTable[i].mboxID = MboxCreate(0, 0);
+    ProcTable[i].mboxID = MboxCreate(1, 0);
     ProcTable[i].blockSem = semcreateReal(0);
-    ProcTable[i].wakeTime = -1;
-    ProcTable[i].diskTrack = -1;
-    ProcTable[i].nextDiskPtr = NULL;
-    ProcTable[i].prevDiskPtr = NULL;
+    ProcTable[i].sleepTimer.slot = NULL;
+    ProcTable[i].tx = NULL;
+    ProcTable[i].polling = 0;
+    for (unit = 0; unit < USLOSS_DISK_UNITS; unit++) {
+        ProcTable[i].diskReqs[unit].proc = &ProcTable[i];
+        ProcTable[i].diskReqs[unit].next = NULL;
+    }
 }
 
 /* empties proc struct */
@@ -853,178 +2275,217 @@ void emptyProc(int pid) {
     ProcTable[i].pid = -1; 
     ProcTable[i].mboxID = -1;
     ProcTable[i].blockSem = -1;
-    ProcTable[i].wakeTime = -1;
-    ProcTable[i].nextDiskPtr = NULL;
-    ProcTable[i].prevDiskPtr = NULL;
 }
 
 /* ------------------------------------------------------------------------
-  Functions for the dskQueue and heap.
+  Functions for the dskQueue and timer wheel.
    ----------------------------------------------------------------------- */
 
-/* Initialize the given diskQueue */
-void initDiskQueue(diskQueue* q) {
-    q->head = NULL;
-    q->tail = NULL;
+/* Initialize the given diskQueue for a disk with the given number of tracks */
+void initDiskQueue(diskQueue* q, int tracks) {
+    q->heads = calloc(tracks, sizeof(diskReq *));
+    q->tails = calloc(tracks, sizeof(diskReq *));
+    q->busy = calloc((tracks + DISKQ_BITS - 1) / DISKQ_BITS, sizeof(unsigned int));
+    q->tracks = tracks;
+    q->sweep = 0;
     q->curr = NULL;
     q->size = 0;
 }
 
-/* Adds the proc pointer to the disk queue in sorted order */
-void addDiskQ(diskQueue* q, procPtr p) {
+/* Adds the request to the end of its track's bucket on the disk queue */
+void addDiskQ(diskQueue* q, diskReq *p) {
     if (debug4)
-        USLOSS_Console("addDiskQ: adding pid %d, track %d to queue\n", p->pid, p->diskTrack);
+        USLOSS_Console("addDiskQ: adding pid %d, track %d to queue\n", p->proc->pid, p->track);
+
+    p->queued = USLOSS_Clock();
 
-    // first add
-    if (q->head == NULL) { 
-        q->head = q->tail = p;
-        q->head->nextDiskPtr = q->tail->nextDiskPtr = NULL;
-        q->head->prevDiskPtr = q->tail->prevDiskPtr = NULL;
+    int track = p->track;
+    p->next = NULL;
+    if (q->heads[track] == NULL) {
+        q->heads[track] = q->tails[track] = p;
+        q->busy[track / DISKQ_BITS] |= 1u << (track % DISKQ_BITS);
     }
     else {
-        // find the right location to add
-        procPtr prev = q->tail;
-        procPtr next = q->head;
-        while (next != NULL && next->diskTrack <= p->diskTrack) {
-            prev = next;
-            next = next->nextDiskPtr;
-            if (next == q->head)
-                break;
-        }
-        if (debug4)
-            USLOSS_Console("addDiskQ: found place, prev = %d\n", prev->diskTrack);
-        prev->nextDiskPtr = p;
-        p->prevDiskPtr = prev;
-        if (next == NULL)
-            next = q->head;
-        p->nextDiskPtr = next;
-        next->prevDiskPtr = p;
-        if (p->diskTrack < q->head->diskTrack)
-            q->head = p; // update head
-        if (p->diskTrack >= q->tail->diskTrack)
-            q->tail = p; // update tail
+        q->tails[track]->next = p;
+        q->tails[track] = p;
     }
     q->size++;
+
+    // queue depth statistics, q is one of diskQs
+    DiskStat *stats = &diskUnits[q - diskQs].stats;
+    stats->queueDepthSum += q->size;
+    if (q->size > stats->maxQueueDepth)
+        stats->maxQueueDepth = q->size;
+
     if (debug4)
         USLOSS_Console("addDiskQ: add complete, size = %d\n", q->size);
 } 
 
-/* Returns the next proc on the disk queue */
-procPtr peekDiskQ(diskQueue* q) {
-    if (q->curr == NULL) {
-        q->curr = q->head;
+/* Returns the first track at or after from with requests waiting, -1 if none */
+static int diskNextTrack(diskQueue* q, int from) {
+    int words = (q->tracks + DISKQ_BITS - 1) / DISKQ_BITS;
+    int w = from / DISKQ_BITS;
+
+    if (w >= words)
+        return -1;
+
+    unsigned int bits = q->busy[w] & (~0u << (from % DISKQ_BITS));
+    while (bits == 0) {
+        if (++w == words)
+            return -1;
+        bits = q->busy[w];
+    }
+    return w * DISKQ_BITS + ffs(bits) - 1;
+}
+
+/* Returns the next request on the disk queue, continuing the sweep from
+ * the last track served and wrapping around to the lowest track */
+diskReq *peekDiskQ(diskQueue* q) {
+    if (q->curr == NULL && q->size > 0) {
+        int track = diskNextTrack(q, q->sweep);
+        if (track == -1)
+            track = diskNextTrack(q, 0);
+        q->curr = q->heads[track];
     }
 
     return q->curr;
 }
 
-/* Returns and removes the next proc on the disk queue */
-procPtr removeDiskQ(diskQueue* q) {
+/* Returns and removes the next request on the disk queue */
+diskReq *removeDiskQ(diskQueue* q) {
     if (q->size == 0)
         return NULL;
 
-    if (q->curr == NULL) {
-        q->curr = q->head;
-    }
+    diskReq *temp = peekDiskQ(q);
+    int track = temp->track;
 
     if (debug4)
-        USLOSS_Console("removeDiskQ: called, size = %d, curr pid = %d, curr track = %d\n", q->size, q->curr->pid, q->curr->diskTrack);
-
-    procPtr temp = q->curr;
-
-    if (q->size == 1) { // remove only node
-        q->head = q->tail = q->curr = NULL;
-    }
-
-    else if (q->curr == q->head) { // remove head
-        q->head = q->head->nextDiskPtr;
-        q->head->prevDiskPtr = q->tail;
-        q->tail->nextDiskPtr = q->head;
-        q->curr = q->head;
-    }
-
-    else if (q->curr == q->tail) { // remove tail
-        q->tail = q->tail->prevDiskPtr;
-        q->tail->nextDiskPtr = q->head;
-        q->head->prevDiskPtr = q->tail;
-        q->curr = q->head;
-    }
+        USLOSS_Console("removeDiskQ: called, size = %d, curr pid = %d, curr track = %d\n", q->size, temp->proc->pid, track);
 
-    else { // remove other
-        q->curr->prevDiskPtr->nextDiskPtr = q->curr->nextDiskPtr;
-        q->curr->nextDiskPtr->prevDiskPtr = q->curr->prevDiskPtr;
-        q->curr = q->curr->nextDiskPtr;
+    q->heads[track] = temp->next;
+    if (q->heads[track] == NULL) {
+        q->tails[track] = NULL;
+        q->busy[track / DISKQ_BITS] &= ~(1u << (track % DISKQ_BITS));
     }
+    temp->next = NULL;
 
+    q->sweep = track;
+    q->curr = NULL;
     q->size--;
 
     if (debug4)
-        USLOSS_Console("removeDiskQ: done, size = %d, curr pid = %d, curr track = %d\n", q->size, temp->pid, temp->diskTrack);
+        USLOSS_Console("removeDiskQ: done, size = %d\n", q->size);
 
     return temp;
 } 
 
 
-/* Setup heap, implementation based on https://gist.github.com/aatishnn/8265656 */
-void initHeap(heap* h) {
-    h->size = 0;
+/*------------------------------------------------------------------------
+    timerAdd: Sets the timer to go off in the given number of microseconds,
+        calling t->func from the clock interrupt. The timer goes off at the
+        first clock interrupt at or after its deadline.
+ ------------------------------------------------------------------------*/
+void timerAdd(timer *t, int us) {
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (t->slot != NULL)
+        timerCancel(t);
+    t->deadline = USLOSS_Clock() + us;
+    timerInsert(t);
+
+    USLOSS_PsrSet(psr);
 }
 
-/* Add to heap */
-void heapAdd(heap * h, procPtr p) {
-    // start from bottom and find correct place
-    int i, parent;
-    for (i = h->size; i > 0; i = parent) {
-        parent = (i-1)/2;
-        if (h->procs[parent]->wakeTime <= p->wakeTime)
+/* Stops the timer, if it is set */
+void timerCancel(timer *t) {
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (t->slot != NULL) {
+        if (t->prev != NULL)
+            t->prev->next = t->next;
+        else
+            *t->slot = t->next;
+        if (t->next != NULL)
+            t->next->prev = t->prev;
+        t->slot = NULL;
+    }
+
+    USLOSS_PsrSet(psr);
+}
+
+/* Puts the timer on the wheel slot for its deadline, the lowest level
+ * that reaches that far */
+static void timerInsert(timer *t) {
+    int ticks = (t->deadline - timers.lastTick + TIMER_TICK_US - 1) / TIMER_TICK_US - 1;
+    int level;
+
+    if (ticks < 0)
+        ticks = 0;
+    if (ticks >= 1 << (TIMER_LEVELS * TIMER_BITS))
+        ticks = (1 << (TIMER_LEVELS * TIMER_BITS)) - 1;
+    t->expires = timers.now + ticks;
+
+    for (level = 0; level < TIMER_LEVELS - 1; level++) {
+        if (ticks < 1 << ((level + 1) * TIMER_BITS))
             break;
-        // move parent down
-        h->procs[i] = h->procs[parent];
     }
-    h->procs[i] = p; // put at final location
-    h->size++;
-    if (debug4) 
-        USLOSS_Console("heapAdd: Added proc %d to heap at index %d, size = %d\n", p->pid, i, h->size);
-} 
 
-/* Return min process on heap */
-procPtr heapPeek(heap * h) {
-    return h->procs[0];
-}
-
-/* Remove earlist waking process form the heap */
-procPtr heapRemove(heap * h) {
-  if (h->size == 0)
-    return NULL;
-
-    procPtr removed = h->procs[0]; // remove min
-    h->size--;
-    h->procs[0] = h->procs[h->size]; // put last in first spot
-
-    // re-heapify
-    int i = 0, left, right, min = 0;
-    while (i*2 <= h->size) {
-        // get locations of children
-        left = i*2 + 1;
-        right = i*2 + 2;
-
-        // get min child
-        if (left <= h->size && h->procs[left]->wakeTime < h->procs[min]->wakeTime) 
-            min = left;
-        if (right <= h->size && h->procs[right]->wakeTime < h->procs[min]->wakeTime) 
-            min = right;
-
-        // swap current with min child if needed
-        if (min != i) {
-            procPtr temp = h->procs[i];
-            h->procs[i] = h->procs[min];
-            h->procs[min] = temp;
-            i = min;
+    t->slot = &timers.slots[level][(t->expires >> (level * TIMER_BITS)) & TIMER_MASK];
+    t->prev = NULL;
+    t->next = *t->slot;
+    if (t->next != NULL)
+        t->next->prev = t;
+    *t->slot = t;
+}
+
+/* Moves the timers in the given slot down to the levels below */
+static void timerCascade(int level, int index) {
+    timer *t = timers.slots[level][index];
+    timers.slots[level][index] = NULL;
+
+    while (t != NULL) {
+        timer *next = t->next;
+        int ticks = t->expires - timers.now;
+        int lower;
+
+        for (lower = 0; lower < level - 1; lower++) {
+            if (ticks < 1 << ((lower + 1) * TIMER_BITS))
+                break;
         }
-        else
-            break; // otherwise we're done
+        t->slot = &timers.slots[lower][(t->expires >> (lower * TIMER_BITS)) & TIMER_MASK];
+        t->prev = NULL;
+        t->next = *t->slot;
+        if (t->next != NULL)
+            t->next->prev = t;
+        *t->slot = t;
+
+        t = next;
     }
-    if (debug4) 
-        USLOSS_Console("heapRemove: Called, returning pid %d, size = %d\n", removed->pid, h->size);
-    return removed;
-}
\ No newline at end of file
+}
+
+/* Runs the timers in the next tick's slot whose deadlines have already
+ * passed, so interrupts between clock ticks can wake sleepers early */
+static void timerPoll(void) {
+    timer *t = timers.slots[0][timers.now & TIMER_MASK];
+    int now = USLOSS_Clock();
+
+    while (t != NULL) {
+        timer *next = t->next;
+        if (now - t->deadline >= 0) {
+            timerCancel(t);
+            t->func(t);
+        }
+        t = next;
+    }
+}
+
+/* Timer function that wakes up the process in t->arg */
+static void timerWakeProc(timer *t) {
+    procPtr proc = t->arg;
+
+    if (debug4)
+        USLOSS_Console("timerWakeProc: Waking up process %d\n", proc->pid);
+    MboxCondSend(proc->mboxID, NULL, 0);
+}
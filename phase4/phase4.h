@@ -11,21 +11,115 @@
 
 #define MAXLINE         80
 
+/*
+ * Virtual disk unit striped (RAID-0) across disk units 0 and 1, and the
+ * default stripe size in sectors. DiskStripe changes the stripe size
+ * until the striped unit is first used.
+ */
+
+#define DISK_STRIPED        2
+#define DISK_STRIPE_SECTORS 8
+
+/*
+ * Journaled writes: the most sectors, and the most separate writes
+ * (TxWrite calls), a single transaction can hold.
+ */
+
+#define TX_MAX_SECTORS      32
+#define TX_MAX_WRITES       30
+
+/*
+ * Disk statistics, per unit. Latency histograms are log2 buckets:
+ * bucket 0 counts latencies under 1ms, bucket i those in [2^(i-1), 2^i) ms.
+ */
+
+#define DISK_HIST_BUCKETS 16
+
+typedef struct DiskStat {
+    int requests;       // # of read/write requests serviced
+    int sectors;        // # of sectors read/written
+    int seeks;          // # of seeks issued
+    int seekDistance;   // total # of tracks the arm moved
+    int maxQueueDepth;  // most requests ever waiting on the unit
+    int queueDepthSum;  // sum of the queue depth seen by each request
+    int queueTime;      // total time requests spent queued, in us
+    int serviceTime;    // total time spent servicing requests, in us
+    int ops;            // # of operations issued to the device
+    int wakeups;        // # of times the driver was woken for an operation
+    int queueHist[DISK_HIST_BUCKETS];   // queueing latency histogram
+    int serviceHist[DISK_HIST_BUCKETS]; // service latency histogram
+} DiskStat;
+
+/*
+ * Terminal settings, read and changed with TermIoctl. In raw mode
+ * TermRead returns bytes as they come in instead of whole lines, like
+ * POSIX VMIN/VTIME: it waits for vmin bytes, but once a byte has come
+ * in gives up on the rest after vtime ms without another. With vmin 0 it
+ * waits at most vtime ms for the first byte. lineSize is the longest
+ * line delivered in line mode, bufSize the size of the input ring.
+ */
+
+#define TERM_GETCONFIG      1
+#define TERM_SETCONFIG      2
+#define TERM_MAX_LINE       1024
+#define TERM_MAX_BUF        4096
+
+typedef struct TermConfig {
+    int raw;            // 1 for raw mode, 0 for lines
+    int vmin;           // raw: bytes to wait for
+    int vtime;          // raw: ms to wait between bytes, 0 for no limit
+    int lineSize;       // longest line, MAXLINE by default
+    int bufSize;        // input ring size, only changed while it is empty
+} TermConfig;
+
+/*
+ * TermPoll entries. A POLL_TERM entry is ready when a line can be read
+ * from terminal unit id without blocking. A POLL_MBOX entry is ready when
+ * a message was received from mailbox id into buf; result is its size.
+ */
+
+#define POLL_TERM           1
+#define POLL_MBOX           2
+#define POLL_MAX            16
+
+typedef struct PollFd {
+    int type;           // POLL_TERM or POLL_MBOX
+    int id;             // terminal unit or mailbox id
+    void *buf;          // POLL_MBOX: where to receive the message
+    int size;           // POLL_MBOX: size of buf
+    int ready;          // set to 1 if the entry is ready, 0 otherwise
+    int result;         // POLL_MBOX: size of the message received
+} PollFd;
+
 /*
  * Function prototypes for this phase.
  */
 
 extern  int  Sleep(int seconds);
+extern  int  SleepMs(int milliseconds);
+extern  int  SleepUs(int microseconds);
+extern  int  CPUTimes(int pid, int *user, int *kernel, int *interrupt);
 
 extern  int  DiskRead (void *diskBuffer, int unit, int track, int first, 
                        int sectors, int *status);
 extern  int  DiskWrite(void *diskBuffer, int unit, int track, int first,
                        int sectors, int *status);
 extern  int  DiskSize (int unit, int *sector, int *track, int *disk);
+extern  int  DiskStats(int unit, DiskStat *stats);
+extern  int  DiskStripe(int sectors);
+extern  int  TxBegin  (void);
+extern  int  TxWrite  (void *diskBuffer, int unit, int track, int first,
+                       int sectors);
+extern  int  TxCommit (void);
+extern  int  TxAbort  (void);
 extern  int  TermRead (char *buffer, int bufferSize, int unitID,
                        int *numCharsRead);
 extern  int  TermWrite(char *buffer, int bufferSize, int unitID,
                        int *numCharsRead);
+extern  int  TermReadNB(char *buffer, int bufferSize, int unitID,
+                       int *numCharsRead);
+extern  int  TermPoll (PollFd *fds, int nfds, int timeoutMs);
+extern  int  TermIoctl(int unitID, int request, TermConfig *config);
 
 extern  int  start4(char *);
 
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * Sleep jitter benchmark: a poller sleeps for PERIOD_MS, ITERATIONS
+ * times, and reports how late each wakeup was. It runs once on an idle
+ * system and once with a process keeping disk 0 busy, since disk
+ * interrupts between clock ticks also wake sleepers.
+ */
+
+#define PERIOD_MS   10
+#define ITERATIONS  50
+#define BUCKETS     8
+
+int busy = 0;
+
+int Poller(char *arg)
+{
+    int begin, end, late, bucket, i;
+    int min = 0, max = 0, sum = 0;
+    int hist[BUCKETS] = {0};
+
+    for (i = 0; i < ITERATIONS; i++) {
+        GetTimeofDay(&begin);
+        SleepMs(PERIOD_MS);
+        GetTimeofDay(&end);
+
+        late = end - begin - PERIOD_MS * 1000;
+        if (late < 0) {
+            USLOSS_Console("Poller(): woke up %d us early\n", -late);
+        }
+        if (i == 0 || late < min)
+            min = late;
+        if (i == 0 || late > max)
+            max = late;
+        sum += late;
+        bucket = late / 5000;
+        if (bucket < 0)
+            bucket = 0;
+        if (bucket >= BUCKETS)
+            bucket = BUCKETS - 1;
+        hist[bucket]++;
+    }
+
+    USLOSS_Console("Poller(): %s, %d sleeps of %d ms\n", arg, ITERATIONS, PERIOD_MS);
+    USLOSS_Console("Poller(): late min %d us, avg %d us, max %d us\n",
+                   min, sum / ITERATIONS, max);
+    for (i = 0; i < BUCKETS; i++) {
+        if (hist[i] > 0)
+            USLOSS_Console("Poller():   %2d - %2d ms late: %d\n", i * 5, i * 5 + 5, hist[i]);
+    }
+    busy = 0;
+    Terminate(1);
+
+    return 0;
+} /* Poller */
+
+
+int Reader(char *arg)
+{
+    char buffer[USLOSS_DISK_SECTOR_SIZE];
+    int status, track = 0;
+
+    while (busy) {
+        DiskRead(buffer, 0, track, 0, 1, &status);
+        track = (track + 7) % 16;
+    }
+    Terminate(2);
+
+    return 0;
+} /* Reader */
+
+
+int start4(char *arg)
+{
+    int pid, status;
+
+    USLOSS_Console("start4(): Measure the wakeup jitter of a %d ms sleep, idle\n", PERIOD_MS);
+    USLOSS_Console("          and with disk 0 busy.\n");
+
+    Spawn("Poller", Poller, "idle", USLOSS_MIN_STACK, 2, &pid);
+    Wait(&pid, &status);
+
+    busy = 1;
+    Spawn("Poller", Poller, "disk busy", USLOSS_MIN_STACK, 2, &pid);
+    Spawn("Reader", Reader, NULL, USLOSS_MIN_STACK, 4, &pid);
+    Wait(&pid, &status);
+    Wait(&pid, &status);
+
+    USLOSS_Console("start4(): Test sleep jitter done.\n");
+    Terminate(0);
+
+    return 0;
+}
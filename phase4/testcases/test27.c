@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * Stripe size: sets the striped unit's stripe size to STRIPE sectors,
+ * writes SECTORS sectors through it, and checks that each one landed on
+ * the unit and sector the stripe size puts it on. Then checks that the
+ * stripe size can no longer be changed.
+ */
+
+#define STRIPE      4
+#define SECTORS     (4 * STRIPE * USLOSS_DISK_UNITS)
+
+char buffer[SECTORS * USLOSS_DISK_SECTOR_SIZE];
+char sector[USLOSS_DISK_SECTOR_SIZE];
+
+int start4(char *arg)
+{
+    int l, unit, physical, status, result;
+
+    USLOSS_Console("start4(): Write %d sectors to the striped unit with %d sector stripes.\n",
+                   SECTORS, STRIPE);
+
+    assert(DiskStripe(0) == -1);
+    assert(DiskStripe(3) == -1); // doesn't divide a track
+    result = DiskStripe(STRIPE);
+    assert(result == 0);
+
+    for (l = 0; l < SECTORS; l++)
+        memset(buffer + l * USLOSS_DISK_SECTOR_SIZE, 'A' + l % 26, USLOSS_DISK_SECTOR_SIZE);
+    result = DiskWrite(buffer, DISK_STRIPED, 0, 0, SECTORS, &status);
+    assert(result == 0 && status == 0);
+
+    // logical sector l is in stripe l/STRIPE, and the stripes alternate
+    // between the units
+    for (l = 0; l < SECTORS; l++) {
+        unit = (l / STRIPE) % USLOSS_DISK_UNITS;
+        physical = (l / STRIPE / USLOSS_DISK_UNITS) * STRIPE + l % STRIPE;
+        result = DiskRead(sector, unit, physical / USLOSS_DISK_TRACK_SIZE,
+                          physical % USLOSS_DISK_TRACK_SIZE, 1, &status);
+        assert(result == 0 && status == 0);
+        assert(sector[0] == 'A' + l % 26);
+    }
+
+    result = DiskStripe(2 * STRIPE);
+    assert(result == -2);
+
+    USLOSS_Console("start4(): Test stripe size done.\n");
+    Terminate(0);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+#include <usyscall.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * CPU times: a spinner runs its own code until it has SPIN_US of user
+ * time, and a caller makes CALLS system calls. Each checks that its time
+ * was charged to the mode it spent it in. Then checks that a process
+ * that has quit has no times.
+ */
+
+#define SPIN_US     50000
+#define CALLS       2000
+
+int Spinner(char *arg)
+{
+    int pid, user, kernel, interrupt, i, result;
+    volatile int count = 0;
+
+    GetPID(&pid);
+    do {
+        for (i = 0; i < 100000; i++)
+            count++;
+        result = CPUTimes(pid, &user, &kernel, &interrupt);
+        assert(result == 0);
+    } while (user < SPIN_US);
+    assert(user > kernel);
+
+    USLOSS_Console("Spinner(): user time is more than system call time\n");
+    Terminate(0);
+
+    return 0;
+}
+
+int Caller(char *arg)
+{
+    int pid, user, kernel, interrupt, i, result;
+
+    for (i = 0; i < CALLS; i++)
+        GetPID(&pid);
+    result = CPUTimes(pid, &user, &kernel, &interrupt);
+    assert(result == 0);
+    assert(kernel > 0);
+
+    USLOSS_Console("Caller(): system calls were charged to system call time\n");
+    Terminate(0);
+
+    return 0;
+}
+
+int start4(char *arg)
+{
+    int pid, status, user, kernel, interrupt, result;
+
+    USLOSS_Console("start4(): Spawn a process that spins and one that makes system calls.\n");
+
+    Spawn("Spinner", Spinner, NULL, USLOSS_MIN_STACK, 3, &pid);
+    Wait(&pid, &status);
+    result = CPUTimes(pid, &user, &kernel, &interrupt);
+    assert(result == -1);
+
+    Spawn("Caller", Caller, NULL, USLOSS_MIN_STACK, 3, &pid);
+    Wait(&pid, &status);
+    result = CPUTimes(pid, &user, &kernel, &interrupt);
+    assert(result == -1);
+
+    result = CPUTimes(-1, &user, &kernel, &interrupt);
+    assert(result == -1);
+
+    USLOSS_Console("start4(): Test CPU times done.\n");
+    Terminate(0);
+
+    return 0;
+}
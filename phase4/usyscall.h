@@ -26,6 +26,7 @@
 #define SYS_GETTIMEOFDAY	20
 #define SYS_CPUTIME		21
 #define SYS_GETPID		22
+#define SYS_CPUTIMES		23
 
 #ifdef PHASE_3
 #define SYS_VMINIT		24
@@ -37,9 +38,20 @@
 #define SYS_COW			30
 #endif
 
+// Phase 4 extensions
+#define SYS_DISKSTATS		31
+#define SYS_TXBEGIN		32
+#define SYS_TXWRITE		33
+#define SYS_TXCOMMIT		34
+#define SYS_TXABORT		35
+#define SYS_SLEEPUS		36
+#define SYS_TERMPOLL		37
+#define SYS_TERMIOCTL		38
+#define SYS_DISKSTRIPE		39
+
 // Leave some room for growth
 
-#define USLOSS_MAX_SYSCALLS	30	
+#define USLOSS_MAX_SYSCALLS	40	
 
 
 /*  The USLOSS_Sysargs structure */
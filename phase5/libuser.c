@@ -621,6 +621,7 @@ int VmInit(int mappings, int pages, int frames, int pagers, void **region)
     sysArg.arg2 = (void *) (long) pages;
     sysArg.arg3 = (void *) (long) frames;
     sysArg.arg4 = (void *) (long) pagers;
+    sysArg.arg5 = (void *) (long) POLICY_CLOCK;
 
     USLOSS_Syscall(&sysArg);
 
@@ -636,6 +637,45 @@ int VmInit(int mappings, int pages, int frames, int pagers, void **region)
 } /* VmInit */
 
 
+/*
+ *  Routine:  VmInitPolicy
+ *
+ *  Description: Initializes the virtual memory system with the given
+ *               page replacement policy.
+ *
+ *  Arguments:    int mappings -- # of mappings in the MMU
+ *                int pages -- # pages in the VM region
+ *                int frames -- # physical page frames
+ *                int pagers -- # pagers to use
+ *                int policy -- POLICY_CLOCK, POLICY_WSCLOCK, POLICY_AGING
+ *                              or POLICY_FIFO
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments, -2 means
+ *                the VM system was already initialized
+ *
+ */
+int VmInitPolicy(int mappings, int pages, int frames, int pagers, int policy,
+                 void **region)
+{
+    systemArgs sysArg;
+
+    CHECKMODE;
+
+    sysArg.number = SYS_VMINIT;
+    sysArg.arg1 = (void *) (long) mappings;
+    sysArg.arg2 = (void *) (long) pages;
+    sysArg.arg3 = (void *) (long) frames;
+    sysArg.arg4 = (void *) (long) pagers;
+    sysArg.arg5 = (void *) (long) policy;
+
+    USLOSS_Syscall(&sysArg);
+
+    *region = sysArg.arg1;  // return address of VM Region
+
+    return (int) (long) sysArg.arg4;
+} /* VmInitPolicy */
+
+
 /*
  *  Routine:  VmDestroy
  *
@@ -658,4 +698,86 @@ VmDestroy(void) {
 } /* VmDestroy */
 
 
+/*
+ *  Routine:  VmCow
+ *
+ *  Description: Turns copy-on-write forking on or off for the calling
+ *               process. While it is on, processes it spawns share its
+ *               pages read-only until one of them writes to a page.
+ *
+ *  Arguments:    int enable -- 1 to turn it on, 0 to turn it off
+ *
+ *  Return Value: 0 means success, -1 means the caller isn't using the
+ *                VM region
+ *
+ */
+int
+VmCow(int enable) {
+    systemArgs     sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_COW;
+    sysArg.arg1 = (void *) (long) enable;
+    USLOSS_Syscall(&sysArg);
+    return (int) (long) sysArg.arg4;
+} /* VmCow */
+
+
+/*
+ *  Routine:  VmShare
+ *
+ *  Description: Shares the caller's pages with another process, at the
+ *               same addresses in its VM region. The other process's
+ *               own pages there are dropped; from then on writes by
+ *               either process are seen by both.
+ *
+ *  Arguments:    int pid -- process to share the pages with
+ *                int page -- first page to share
+ *                int pages -- # of pages to share
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments or a page
+ *                still shared copy-on-write
+ *
+ */
+int
+VmShare(int pid, int page, int pages) {
+    systemArgs     sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_SHARE;
+    sysArg.arg1 = (void *) (long) pid;
+    sysArg.arg2 = (void *) (long) page;
+    sysArg.arg3 = (void *) (long) pages;
+    USLOSS_Syscall(&sysArg);
+    return (int) (long) sysArg.arg4;
+} /* VmShare */
+
+
+/*
+ *  Routine:  VmTune
+ *
+ *  Description: Sets one of the VM system's options, VM_FAULT_AROUND,
+ *               VM_ZERO_POOL, VM_ZERO_SHARE or VM_PAGE_DAEMON, for the
+ *               next VmInit.
+ *
+ *  Arguments:    int option -- option to set
+ *                int value -- its new value, at least 0
+ *
+ *  Return Value: 0 means success, -1 means invalid arguments, -2 means
+ *                the VM system is initialized
+ *
+ */
+int
+VmTune(int option, int value) {
+    systemArgs     sysArg;
+
+    CHECKMODE;
+    sysArg.number = SYS_VMTUNE;
+    sysArg.arg1 = (void *) (long) option;
+    sysArg.arg2 = (void *) (long) value;
+    USLOSS_Syscall(&sysArg);
+    return (int) (long) sysArg.arg4;
+} /* VmTune */
+
+
 /* end libuser.c */
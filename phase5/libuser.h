@@ -46,6 +46,11 @@ extern int  Mbox_CondReceive(int mboxID, void *msgPtr, int msgSize);
 
 extern int VmInit(int mappings, int pages, int frames, int pagers,
                   void **region);
+extern int VmInitPolicy(int mappings, int pages, int frames, int pagers,
+                        int policy, void **region);
 extern int VmDestroy(void);
+extern int VmCow(int enable);
+extern int VmShare(int pid, int page, int pages);
+extern int VmTune(int option, int value);
 
 #endif
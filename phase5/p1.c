@@ -5,13 +5,18 @@
 #include <mmu.h>
 #include <phase5.h>
 
-#define TAG 0
 extern int debug5;
 extern Process processes[MAXPROC];
 extern FTE *frameTable;
 extern DTE *diskTable;
 extern void *vmRegion;
 extern VmStats vmStats;
+extern void tagLoad(Process *);
+extern void tagRelease(Process *);
+extern void diskBlockFree(int);
+extern void frameDrop(Process *, int);
+extern void cowShare(Process *, Process *);
+extern void regionLeave(Process *, int);
 
 
 /* Fills the given PTE with default values */
@@ -19,6 +24,9 @@ void clearPage(PTE *page) {
     page->state = UNUSED;
     page->frame = -1;
     page->diskBlock = -1;
+    page->cow = 0;
+    page->share = 0;
+    page->shareNext = -1;
     // clear from disk table and frame table too
 }
 
@@ -37,6 +45,12 @@ p1_fork(int pid)
     if (vmRegion > 0) {
         Process *proc = &processes[pid % MAXPROC];
         proc->pid = pid;
+        proc->resident = -1;
+        proc->tag = -1;
+        proc->nextFault = -1;
+        proc->seqRun = 0;
+        proc->cowFork = 0;
+        proc->borrowed = 0;
         if (debug5)
             USLOSS_Console("p1_fork(): creating page table with %d pages\n", proc->numPages);
     	// create the process's page table
@@ -47,6 +61,10 @@ p1_fork(int pid)
         for (i = 0; i < proc->numPages; i++) {
             clearPage(&proc->pageTable[i]);
         }
+        // p1_fork runs in the parent, which may share its pages
+        Process *parent = &processes[getpid() % MAXPROC];
+        if (parent->pid == getpid() && parent->cowFork && parent->pageTable != NULL)
+            cowShare(parent, proc);
         if (debug5)
             USLOSS_Console("p1_fork(): done \n"); 
     }
@@ -68,45 +86,21 @@ p1_switch(int old, int new)
     	return;
 
 	vmStats.switches++;
-	int i;
-
-	// unload old process's mappings
-	if (old > 0) {
-		int dummy, dummy2, result; // used to check mappings
-		Process *oldProc = &processes[old % MAXPROC];
-		if (oldProc->pageTable != NULL) {
-			for (i = 0; i < oldProc->numPages; i++) {
-				// check if there is a valid mapping
-				result = USLOSS_MmuGetMap(TAG, i, &dummy, &dummy2);
-				if (result != USLOSS_MMU_ERR_NOMAP) { 
-					USLOSS_MmuUnmap(TAG, i);
-                    if (debug5)
-                        USLOSS_Console("p1_switch(): unmapped page %d for proc %d \n", i, old);
-                }
-			}
-		}
-	}
-
-	// map new process's pages
-	if (new > 0) {
-		Process *newProc = &processes[new % MAXPROC];
-		if (newProc->pageTable != NULL) {
-			for (i = 0; i < newProc->numPages; i++) {
-				if (newProc->pageTable[i].state == INFRAME) { // check if there is a valid mapping
-					USLOSS_MmuMap(TAG, i, newProc->pageTable[i].frame, USLOSS_MMU_PROT_RW);
-                    if (debug5)
-                        USLOSS_Console("p1_switch(): mapped page %d to frame %d for proc %d \n", i, newProc->pageTable[i].frame, new);
-                }
-			}
-		}    	
-	}
+
+	// the old process's mappings stay under its tag, so switching is
+	// just a tag change unless the new process has to be given one
+	Process *newProc = new > 0 ? &processes[new % MAXPROC] : NULL;
+	if (newProc != NULL && newProc->pid == new && newProc->pageTable != NULL)
+		tagLoad(newProc);
+	else
+		USLOSS_MmuSetTag(TAG);
 
 } /* p1_switch */
 
 void
 p1_quit(int pid)
 {
-	int i, frame, dummy, result;
+	int i, psr;
 
     if (debug5)
         USLOSS_Console("p1_quit() called: pid = %d\n", pid);
@@ -116,36 +110,33 @@ p1_quit(int pid)
     	Process *proc = &processes[pid % MAXPROC];
         if (proc->pageTable == NULL) 
             return;
+		// unmap the pages and free the frames, or leave them to the
+		// processes still sharing them
+		psr = USLOSS_PsrGet();
+		USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+		tagRelease(proc);
     	for (i = 0; i < proc->numPages; i++) {
-    		// free the frames
-    		result = USLOSS_MmuGetMap(TAG, i, &frame, &dummy);
-			if (result != USLOSS_MMU_ERR_NOMAP) { 
-				// free the disk block
-				if (proc->pageTable[i].diskBlock > -1) {
-					diskTable[proc->pageTable[i].diskBlock].pid = -1;
-					diskTable[proc->pageTable[i].diskBlock].page = -1;
-					//vmStats.freeDiskBlocks++;
-				}
-
-				USLOSS_MmuUnmap(TAG, i); // unmap
-
-				// free the frame
-				frameTable[frame].pid = -1;
-				frameTable[frame].state = UNUSED;
-				frameTable[frame].page = -1;
-				vmStats.freeFrames++;
-				if (debug5)
-        			USLOSS_Console("p1_quit(): freed frame %d, free frames = %d \n", frame, vmStats.freeFrames);
-			}
+			if (proc->pageTable[i].state == INFRAME)
+				frameDrop(proc, proc->pageTable[i].frame);
+
+			// free the disk block, paged out or not
+			if (proc->pageTable[i].diskBlock > -1)
+				diskBlockFree(proc->pageTable[i].diskBlock);
+			if (proc->pageTable[i].share != 0)
+				regionLeave(proc, i);
 
             clearPage(&proc->pageTable[i]);
     	}
+		USLOSS_PsrSet(psr);
+		if (debug5)
+			USLOSS_Console("p1_quit(): freed frames, free frames = %d \n", vmStats.freeFrames);
 
     	if (debug5)
         	USLOSS_Console("p1_quit(): cleared pages \n");
 
     	// destroy the page table
     	free(proc->pageTable); 
+    	proc->pageTable = NULL;
 
     	if (debug5)
         	USLOSS_Console("p1_quit(): freed page table \n");
@@ -29,6 +29,14 @@ extern  int  TermWrite(char *buffer, int bufferSize, int unitID,
 
 extern  int  start4(char *);
 
+/*
+ * Unit number of the virtual disk striped across units 0 and 1, and the
+ * default number of sectors per stripe.
+ */
+
+#define DISK_STRIPED            2
+#define DISK_STRIPE_SECTORS     8
+
 #define ERR_INVALID             -1
 #define ERR_OK                  0
 
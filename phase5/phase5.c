@@ -8,6 +8,7 @@
 #include <libuser.h>
 #include <vm.h>
 #include <string.h>
+#include <strings.h> /* needed for ffs() */
 #include <providedPrototypes.h>
 
 extern void mbox_create(systemArgs *args_ptr);
@@ -24,9 +25,55 @@ FaultHandler(int  type,  // USLOSS_MMU_INT
              void *arg); // Offset within VM region
 static void vmInit(systemArgs *systemArgsPtr);
 static void vmDestroy(systemArgs *systemArgsPtr);
-void *vmInitReal(int, int, int, int);
+static void vmCow(systemArgs *systemArgsPtr);
+static void vmShare(systemArgs *systemArgsPtr);
+static void vmTune(systemArgs *systemArgsPtr);
+void *vmInitReal(int, int, int, int, int);
 void vmDestroyReal();
 static int Pager(char *);
+static int pageClaim(Process *, int, int);
+static int pageIn(Process *, int, int, int, int);
+static int frameGet(int, int, int);
+static void cowBreak(Process *, int, int);
+static void frameUse(Process *, int, int);
+static void frameDetach(int, int);
+void frameDrop(Process *, int);
+void cowShare(Process *, Process *);
+static void pageShare(Process *, Process *, int);
+static void frameShare(Process *, int, int);
+static void shareState(int, int, int);
+static int regionAlloc(Process *, int);
+static void regionJoin(int, Process *, int);
+void regionLeave(Process *, int);
+static void regionFree(int);
+static void zeroMap(Process *, int, int);
+static int PageDaemon(char *);
+static int FrameZeroer(char *);
+static void zeroWake(void);
+static int blockClaim(int, PTE *);
+static int clusterGather(int, int, int *);
+static void clusterWrite(int *, int, int, int, int);
+static char *windowMap(int, int, int, int);
+static void windowUnmap(int, int);
+static void claimRelease(void);
+static void claimWait(int);
+static int faultHistBucket(int);
+int frameAlloc(int);
+void frameFree(int);
+void residentAdd(Process *, int);
+void residentRemove(Process *, int);
+void tagLoad(Process *);
+void tagRelease(Process *);
+void pageMap(Process *, int, int);
+void pageUnmap(Process *, int);
+static void pageRemap(Process *, int);
+static int pageProt(PTE *);
+static void tagMap(Process *, int, int);
+static int tagVictim(int);
+int diskBlockAlloc(void);
+int diskBlockTake(int);
+int diskBlockNear(Process *, int);
+void diskBlockFree(int);
 void setUserMode();
 
 /* Globals */
@@ -43,7 +90,44 @@ int faultMBox; // faults waiting for pagers
 int pagerPids[MAXPAGERS]; // pids of the pagers
 void *vmRegion = NULL; // address of the beginning of the virtual memory region
 int clockHand; // index of frame the clock hand is currently at
-int clockSem; // semaphore for moving the clock hand
+int claimSem; // pagers waiting for a claim to be released
+int claimWaiters; // number of them
+int claimEvents; // claims released
+Policy *policy; // page replacement policy
+int freeFrames = -1; // first frame on the free frame list, -1 if empty
+int zeroFrames = -1; // first frame on the list of free zeroed frames
+int zeroCount; // frames on it
+int zeroPool = 4; // zeroed frames the frame zeroer keeps ready
+int zeroShare = 0; // 1 to map the zero frame for first reads of pages
+int zeroFrame = -1; // the shared zero frame, -1 if zeroShare is off
+int zeroerPid = -1; // pid of the frame zeroer, -1 if there isn't one
+int zeroSem; // wakes up the frame zeroer
+int zeroWaking; // 1 if zeroSem has been signalled and not yet taken
+int zeroPoolHits; // new pages given a frame zeroed ahead of time
+int zeroMapped; // new pages given the shared zero frame
+unsigned int *freeBlockMap; // bit set for each free disk block
+int blockWords; // words in freeBlockMap
+int swapWrites; // disk writes of pages to swap
+int daemonPid = -1; // pid of the page daemon, -1 if there isn't one
+int daemonOn = 1; // 0 to run without the page daemon
+int daemonSem; // wakes up the page daemon
+int daemonWaking; // 1 if the page daemon has been woken and not run yet
+int freeLow, freeHigh; // free frame watermarks for the page daemon
+int daemonCleaned; // dirty pages written out by the page daemon
+int daemonFreed; // frames freed by the page daemon
+int faultHist[FAULT_HIST_BUCKETS]; // fault service time histogram
+int tagOwners[USLOSS_MMU_NUM_TAG]; // pid using each tag, -1 if none
+int tagLastUsed[USLOSS_MMU_NUM_TAG]; // tagClock when each tag last ran
+int tagClock; // counts tag loads, for LRU
+int tagSteals; // tags taken from another process
+int bytesCopied; // bytes the VM system copied between buffers and frames
+int faultAround = 0; // most pages brought in after a sequential fault
+int faultAroundPages; // pages brought in by fault-around
+int cowShared; // pages children were given copy-on-write
+int cowCopies; // copy-on-write pages copied on a write
+Region *regions; // shared memory regions, indexed by PTE.share
+int freeRegions; // first free region, 0 if none
+int sharedPages; // pages given to another process by VmShare
 
 
 /*
@@ -79,6 +163,9 @@ start4(char *arg)
     /* user-process access to VM functions */
     systemCallVec[SYS_VMINIT]    = vmInit;
     systemCallVec[SYS_VMDESTROY] = vmDestroy;
+    systemCallVec[SYS_COW]       = vmCow;
+    systemCallVec[SYS_SHARE]     = vmShare;
+    systemCallVec[SYS_VMTUNE]    = vmTune;
 
     result = Spawn("Start5", start5, NULL, 8*USLOSS_MIN_STACK, 2, &pid);
     if (result != 0) {
@@ -119,8 +206,9 @@ vmInit(systemArgs *args)
     int pages = (long) args->arg2;
     int frames = (long) args->arg3;
     int pagers = (long) args->arg4;
+    int replace = (long) args->arg5;
 
-    args->arg1 = vmInitReal(mappings, pages, frames, pagers);
+    args->arg1 = vmInitReal(mappings, pages, frames, pagers, replace);
 
     if ((int) (long) args->arg1 < 0) 
         args->arg4 = args->arg1;
@@ -155,6 +243,188 @@ vmDestroy(systemArgs *args)
 } /* vmDestroy */
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmCow --
+ *
+ * Stub for the VmCow system call. Turns copy-on-write forking on or off
+ * for the calling process: while it is on, processes it spawns start out
+ * sharing its pages, read-only, until one of them writes to a page.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      arg4 is -1 if the caller isn't using the VM region, 0 otherwise.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+vmCow(systemArgs *args)
+{
+    CheckMode();
+
+    int enable = (long) args->arg1;
+    Process *proc = &processes[getpid() % MAXPROC];
+
+    if (vmRegion == NULL || proc->pid != getpid() || proc->pageTable == NULL)
+        args->arg4 = (void *) ((long) -1);
+    else {
+        proc->cowFork = enable != 0;
+        args->arg4 = (void *) ((long) 0);
+    }
+    setUserMode();
+} /* vmCow */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmTune --
+ *
+ * Stub for the VmTune system call. Sets an option (VM_* in phase5.h)
+ * that VmInit and the pagers read; the options can only be changed
+ * while the VM system isn't initialized.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      arg4 is -1 if the arguments are invalid, -2 if the VM system is
+ *      initialized, 0 otherwise.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+vmTune(systemArgs *args)
+{
+    CheckMode();
+
+    int option = (long) args->arg1;
+    int value = (long) args->arg2;
+
+    if (vmRegion != NULL)
+        args->arg4 = (void *) ((long) -2);
+    else if (option < 0 || option >= VM_OPTIONS || value < 0 ||
+             ((option == VM_ZERO_SHARE || option == VM_PAGE_DAEMON) && value > 1))
+        args->arg4 = (void *) ((long) -1);
+    else {
+        switch (option) {
+        case VM_FAULT_AROUND:
+            faultAround = value;
+            break;
+        case VM_ZERO_POOL:
+            zeroPool = value;
+            break;
+        case VM_ZERO_SHARE:
+            zeroShare = value;
+            break;
+        case VM_PAGE_DAEMON:
+            daemonOn = value;
+            break;
+        }
+        args->arg4 = (void *) ((long) 0);
+    }
+    setUserMode();
+} /* vmTune */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * vmShare --
+ *
+ * Stub for the VmShare system call. Shares the caller's pages first to
+ * first + pages - 1 with another process, at the same addresses: the
+ * other process's own pages there are dropped, and from then on both
+ * use the same frames and disk blocks, so writes by either are seen by
+ * both. Pages still shared copy-on-write can't be shared.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      arg4 is -1 if the arguments are invalid, 0 otherwise.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+vmShare(systemArgs *args)
+{
+    CheckMode();
+
+    int pid = (long) args->arg1;
+    int first = (long) args->arg2;
+    int pages = (long) args->arg3;
+    int i, events, psr, busy, result;
+    Process *proc = &processes[getpid() % MAXPROC];
+    Process *other = &processes[pid % MAXPROC];
+    PTE *from, *to;
+
+    result = -1;
+    if (vmRegion != NULL && proc->pid == getpid() && proc->pageTable != NULL &&
+        pid >= 0 && pid != getpid() && pages > 0 && first >= 0 && first + pages <= vmStats.pages) {
+        // wait for the pages to be done being paged in or out
+        do {
+            events = claimEvents;
+            psr = USLOSS_PsrGet();
+            USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+            busy = 0;
+            result = other->pid == pid && other->pageTable != NULL ? 0 : -1;
+            for (i = first; result == 0 && i < first + pages; i++) {
+                from = &proc->pageTable[i];
+                to = &other->pageTable[i];
+                if (from->cow && !(from->state == INFRAME && from->frame == zeroFrame))
+                    result = -1;
+                if (from->state == INCOMING || from->state == OUTGOING ||
+                    to->state == INCOMING || to->state == OUTGOING)
+                    busy = 1;
+            }
+            if (result == 0 && !busy) {
+                for (i = first; i < first + pages; i++) {
+                    from = &proc->pageTable[i];
+                    to = &other->pageTable[i];
+                    // the other process gives up its own page
+                    if (to->share != 0)
+                        regionLeave(other, i);
+                    if (to->state == INFRAME) {
+                        pageUnmap(other, i);
+                        frameDrop(other, to->frame);
+                    }
+                    if (to->diskBlock != -1)
+                        diskBlockFree(to->diskBlock);
+                    to->state = UNUSED;
+                    to->frame = -1;
+                    to->diskBlock = -1;
+                    to->cow = 0;
+
+                    // a page that was only read is made new again, so the
+                    // region doesn't share the zero frame
+                    if (from->state == INFRAME && from->frame == zeroFrame) {
+                        pageUnmap(proc, i);
+                        frameDrop(proc, zeroFrame);
+                        from->state = UNUSED;
+                        from->frame = -1;
+                        from->cow = 0;
+                    }
+                    if (from->share == 0)
+                        regionAlloc(proc, i);
+                    pageShare(proc, other, i);
+                    sharedPages++;
+                }
+            }
+            USLOSS_PsrSet(psr);
+            if (result == 0 && busy)
+                claimWait(events);
+        } while (result == 0 && busy);
+    }
+
+    args->arg4 = (void *) ((long) result);
+    setUserMode();
+} /* vmShare */
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -173,7 +443,7 @@ vmDestroy(systemArgs *args)
  *----------------------------------------------------------------------
  */
 void *
-vmInitReal(int mappings, int pages, int frames, int pagers)
+vmInitReal(int mappings, int pages, int frames, int pagers, int replace)
 {
     CheckMode();    
     int status;
@@ -188,11 +458,13 @@ vmInitReal(int mappings, int pages, int frames, int pagers)
     }
 
     // check for invalid parameters
-    if (mappings != pages) {
+    if (mappings != pages || replace < 0 || replace >= POLICIES) {
         return (void *) ((long) -1);
     }
 
-    status = USLOSS_MmuInit(mappings, pages, frames);
+    // the kernel windows follow the region, mapped under every tag
+    status = USLOSS_MmuInit(mappings + WINDOWS * SWAP_CLUSTER * USLOSS_MMU_NUM_TAG,
+                            pages + WINDOWS * SWAP_CLUSTER, frames);
     if (status != USLOSS_MMU_OK) {
         USLOSS_Console("vmInitReal: couldn't init MMU, status %d\n", status);
         abort();
@@ -209,7 +481,15 @@ vmInitReal(int mappings, int pages, int frames, int pagers)
     for (i = 0; i < frames; i++) {
         frameTable[i].pid = -1;
         frameTable[i].state = UNUSED;
+        frameTable[i].next = i + 1 < frames ? i + 1 : -1;
+        frameTable[i].refs = 0;
+        frameTable[i].zeroed = 0;
     }
+    freeFrames = frames > 0 ? 0 : -1;
+    zeroFrames = -1;
+    zeroCount = 0;
+    zeroPoolHits = 0;
+    zeroMapped = 0;
 
    /*
     * Initialize page tables.
@@ -220,6 +500,12 @@ vmInitReal(int mappings, int pages, int frames, int pagers)
         processes[i].pid = -1; 
         processes[i].numPages = pages; 
         processes[i].pageTable = NULL;
+        processes[i].resident = -1;
+        processes[i].tag = -1;
+        processes[i].nextFault = -1;
+        processes[i].seqRun = 0;
+        processes[i].cowFork = 0;
+        processes[i].borrowed = 0;
 
         // initialize the fault structs
         faults[i].pid = -1;
@@ -232,9 +518,38 @@ vmInitReal(int mappings, int pages, int frames, int pagers)
     */
     faultMBox = MboxCreate(pagers, sizeof(FaultMsg));
 
-    // set up the clock hand
+    // no process has a tag yet
+    for (i = 0; i < USLOSS_MMU_NUM_TAG; i++) {
+        tagOwners[i] = -1;
+        tagLastUsed[i] = 0;
+    }
+    tagClock = 0;
+    tagSteals = 0;
+    bytesCopied = 0;
+    faultAroundPages = 0;
+    swapWrites = 0;
+    cowShared = 0;
+    cowCopies = 0;
+    sharedPages = 0;
+
+    // region 0 is no region. Each page of each process can be in a region
+    // of its own, and each pager can hold on to two whose members all quit
+    // while it was paging them (regionLeave)
+    int regionCount = MAXPROC * pages + 2 * MAXPAGERS + 1;
+    regions = malloc(regionCount * sizeof(Region));
+    for (i = 0; i < regionCount; i++) {
+        regions[i].pid = -1;
+        regions[i].next = i + 1 < regionCount ? i + 1 : 0;
+    }
+    freeRegions = 1;
+
+    // set up the clock hand and the replacement policy; victims are
+    // chosen with interrupts off, so the pagers don't share a lock
     clockHand = 0; // start at frame 0
-    clockSem = semcreateReal(1); // mutex
+    claimSem = semcreateReal(0);
+    claimWaiters = 0;
+    claimEvents = 0;
+    policy = &policies[replace];
 
    /*
     * Fork the pagers.
@@ -246,9 +561,20 @@ vmInitReal(int mappings, int pages, int frames, int pagers)
 
     // fork the pagers
     for (i = 0; i < pagers; i++) {
-        pagerPids[i] = fork1("Pager", Pager, NULL, 8*USLOSS_MIN_STACK, PAGER_PRIORITY);
+        char window[8];
+        sprintf(window, "%d", i); // each pager has its own kernel window
+        pagerPids[i] = fork1("Pager", Pager, window, 8*USLOSS_MIN_STACK, PAGER_PRIORITY);
     }
 
+    // fork the page daemon, below the pagers so faults come first
+    freeLow = frames / FREE_LOW;
+    freeHigh = frames / FREE_HIGH;
+    daemonSem = semcreateReal(0);
+    daemonWaking = 0;
+    daemonPid = -1;
+    if (daemonOn && freeHigh > 0)
+        daemonPid = fork1("PageDaemon", PageDaemon, NULL, 8*USLOSS_MIN_STACK, PAGER_PRIORITY + 1);
+
     // get diskBlocks = tracks on disk
     if (debug5) 
         USLOSS_Console("vmInitReal: getting disk size... \n");
@@ -268,8 +594,16 @@ vmInitReal(int mappings, int pages, int frames, int pagers)
             diskTable[i].sector = 0;
         else // odd blocks start at however many sectors a page takes up
             diskTable[i].sector = USLOSS_MmuPageSize()/USLOSS_DISK_SECTOR_SIZE;
+        diskTable[i].writing = 0;
+        diskTable[i].refs = 0;
     }
 
+    // every block is free
+    blockWords = (diskBlocks + BLOCK_BITS - 1) / BLOCK_BITS;
+    freeBlockMap = calloc(blockWords, sizeof(unsigned int));
+    for (i = 0; i < diskBlocks; i++)
+        freeBlockMap[i / BLOCK_BITS] |= 1u << (i % BLOCK_BITS);
+
    /*
     * Zero out, then initialize, the vmStats structure
     */
@@ -282,6 +616,26 @@ vmInitReal(int mappings, int pages, int frames, int pagers)
     vmStats.new = 0;
 
     vmRegion = USLOSS_MmuRegion(&dummy); // set vmRegion
+
+    // set aside the shared zero frame; no pager is using its window yet
+    zeroFrame = -1;
+    if (zeroShare && (zeroFrame = frameAlloc(0)) != -1) {
+        memset(windowMap(0, 0, zeroFrame, USLOSS_MMU_PROT_RW), 0, USLOSS_MmuPageSize());
+        windowUnmap(0, 1);
+        frameTable[zeroFrame].state = ZEROFRAME;
+        frameTable[zeroFrame].refs = 1; // so dropping a page never frees it
+    }
+
+    // fork the frame zeroer last, since it uses the free frame lists and
+    // vmStats; it fills the zeroed frame pool whenever nothing else runs
+    zeroSem = semcreateReal(0);
+    zeroWaking = 0;
+    zeroerPid = -1;
+    if (zeroPool > 0) {
+        zeroerPid = fork1("FrameZeroer", FrameZeroer, NULL, 8*USLOSS_MIN_STACK, ZEROER_PRIORITY);
+        zeroWake();
+    }
+
     if (debug5) 
         USLOSS_Console("vmInitReal: returning vmRegion = %d \n", vmRegion);
     return vmRegion;
@@ -318,6 +672,32 @@ PrintStats(void)
      USLOSS_Console("pageIns:        %d\n", vmStats.pageIns);
      USLOSS_Console("pageOuts:       %d\n", vmStats.pageOuts);
      USLOSS_Console("replaced:       %d\n", vmStats.replaced);
+
+     if (debug5) {
+         int i;
+         USLOSS_Console("policy:         %s\n", policy->name);
+         USLOSS_Console("daemon cleaned: %d\n", daemonCleaned);
+         USLOSS_Console("daemon freed:   %d\n", daemonFreed);
+         USLOSS_Console("tag steals:     %d\n", tagSteals);
+         USLOSS_Console("fault-around:   %d pages (window %d)\n", faultAroundPages, faultAround);
+         USLOSS_Console("cow shared:     %d\n", cowShared);
+         USLOSS_Console("cow copies:     %d\n", cowCopies);
+         USLOSS_Console("shared pages:   %d\n", sharedPages);
+         USLOSS_Console("zero pool:      %d hits (%d frames)\n", zeroPoolHits, zeroPool);
+         USLOSS_Console("zero mapped:    %d\n", zeroMapped);
+         USLOSS_Console("swap writes:    %d (%d pages)\n", swapWrites, vmStats.pageOuts);
+         USLOSS_Console("bytes copied:   %d (%d per fault)\n", bytesCopied,
+                        vmStats.faults > 0 ? bytesCopied / vmStats.faults : 0);
+         USLOSS_Console("%-14s%10s\n", "fault (ms)", "faults");
+         for (i = 0; i < FAULT_HIST_BUCKETS; i++) {
+             if (faultHist[i] == 0)
+                 continue;
+             if (i == 0)
+                 USLOSS_Console("%-14s%10d\n", "< 1", faultHist[i]);
+             else
+                 USLOSS_Console("%5d - %-6d%10d\n", 1 << (i-1), 1 << i, faultHist[i]);
+         }
+     }
 } /* PrintStats */
 
 
@@ -342,6 +722,10 @@ vmDestroyReal(void)
 {
 
     CheckMode();
+
+    // the frame zeroer stops using its window once zeroerPid is -1
+    int zeroer = zeroerPid;
+    zeroerPid = -1;
     USLOSS_MmuDone();
 
     // do nothing if VM hasn't been initialized yet
@@ -365,6 +749,17 @@ vmDestroyReal(void)
         zap(pagerPids[i]);
         join(&status);
     }
+    if (daemonPid != -1) {
+        semvReal(daemonSem);
+        zap(daemonPid);
+        join(&status);
+        daemonPid = -1;
+    }
+    if (zeroer != -1) {
+        semvReal(zeroSem);
+        zap(zeroer);
+        join(&status);
+    }
 
     // release fault mailboxes
     for (i = 0; i < MAXPROC; i++) {
@@ -382,6 +777,16 @@ vmDestroyReal(void)
     PrintStats();
     /* and so on... */
 
+    // the tables vmInitReal allocated; VmInit makes new ones
+    free(frameTable);
+    free(diskTable);
+    free(freeBlockMap);
+    free(regions);
+    frameTable = NULL;
+    diskTable = NULL;
+    freeBlockMap = NULL;
+    regions = NULL;
+
     vmRegion = NULL;
 } /* vmDestroyReal */
 
@@ -390,8 +795,9 @@ vmDestroyReal(void)
  *
  * FaultHandler
  *
- * Handles an MMU interrupt. Simply stores information about the
- * fault in a queue, wakes a waiting pager, and blocks until
+ * Handles an MMU interrupt, either a fault on an unmapped page or a
+ * write to a read-only (copy-on-write) one. Simply stores information
+ * about the fault in a queue, wakes a waiting pager, and blocks until
  * the fault has been handled.
  *
  * Results:
@@ -415,27 +821,41 @@ FaultHandler(int  type /* USLOSS_MMU_INT */,
 
    assert(type == USLOSS_MMU_INT);
    cause = USLOSS_MmuGetCause();
-   assert(cause == USLOSS_MMU_FAULT);
+   assert(cause == USLOSS_MMU_FAULT || cause == USLOSS_MMU_ACCESS);
+
+   // the MMU region goes on past the VM pages with the kernel windows; a
+   // process touching them, or with no pages at all, is killed rather
+   // than handed to a pager
+   int pid = getpid();
+   Process *proc = &processes[pid % MAXPROC];
+   if (proc->pid != pid || proc->pageTable == NULL || offset < 0 ||
+       offset >= proc->numPages * USLOSS_MmuPageSize()) {
+       USLOSS_Console("FaultHandler: process %d faulted at offset %d, outside its pages; terminating it\n", pid, offset);
+       terminateReal(1);
+       return;
+   }
    vmStats.faults++;
    /*
     * Fill in faults[pid % MAXPROC], send it to the pagers, and wait for the
     * reply.
     */
-   int pid = getpid();
    FaultMsg *fault = &faults[pid % MAXPROC];
    fault->pid = pid;
    fault->addr = processes[pid % MAXPROC].pageTable + offset;
    fault->pageNum = offset/USLOSS_MmuPageSize();
+   fault->cause = cause;
 
    // send to pagers
     if (debug5) 
         USLOSS_Console("FaultHandler: created fault message for proc %d, address %d, sending to pagers... \n", fault->pid, fault->addr);
+   int start = USLOSS_Clock();
    MboxSend(faultMBox, fault, sizeof(FaultMsg));
 
     if (debug5) 
         USLOSS_Console("FaultHandler: sent fault to pagers, blocking... \n");
    // block
    MboxReceive(fault->replyMbox, 0, 0);
+   faultHist[faultHistBucket(USLOSS_Clock() - start)]++;
 
 } /* FaultHandler */
 
@@ -457,11 +877,10 @@ FaultHandler(int  type /* USLOSS_MMU_INT */,
 static int
 Pager(char *buf)
 {
-    int i, frame;
-    char buffer[USLOSS_MmuPageSize()]; // buffer for disk
+    int state, events, psr, i, ahead;
+    int window = atoi(buf); // kernel window on the frame being filled
     Process *proc;
-    PTE *page, *oldPage;
-    DTE *diskBlock;
+    PTE *page;
 
     while(!isZapped()) {
         /* Wait for fault to occur (receive from mailbox) */
@@ -475,148 +894,1454 @@ Pager(char *buf)
         // get process and page 
         proc = &processes[fault.pid % MAXPROC];
         page = &proc->pageTable[fault.pageNum];
-        frame = -1; // set frame to -1 until assigned
-
-        /* Look for free frame */
-        if (vmStats.freeFrames > 0) {
-            for (frame = 0; frame < vmStats.frames; frame++) {
-                if (frameTable[frame].state == UNUSED) {
-                    // map page 0 to frame so we can write to it later
-                    USLOSS_MmuMap(TAG, 0, frame, USLOSS_MMU_PROT_RW);
-                    vmStats.freeFrames--; // decrement free frames
-                    if (debug5) 
-                        USLOSS_Console("Pager: found frame %d free; free frames = %d \n", frame, vmStats.freeFrames);
-                    break;
-                }
+
+        // claim the page, waiting if another pager is writing it out or
+        // bringing it in; fault-around may have brought it in already
+        for (;;) {
+            events = claimEvents;
+            psr = USLOSS_PsrGet();
+            USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+            state = page->state;
+            if (state == UNUSED || state == INCORE) {
+                page->state = INCOMING;
+                shareState(page->share, fault.pageNum, INCOMING);
             }
+            USLOSS_PsrSet(psr);
+            if (state != OUTGOING && state != INCOMING)
+                break;
+            if (debug5)
+                USLOSS_Console("Pager: page %d of proc %d is being paged, waiting... \n", fault.pageNum, fault.pid);
+            claimWait(events);
+        }
+        if (state == UNUSED && zeroFrame != -1 && page->share == 0)
+            zeroMap(proc, fault.pid, fault.pageNum);
+        else if (state != INFRAME)
+            pageIn(proc, fault.pid, fault.pageNum, window, 1);
+        else if (fault.cause == USLOSS_MMU_ACCESS)
+            cowBreak(proc, fault.pageNum, window);
+        else // the page lost its mapping
+            pageRemap(proc, fault.pageNum);
+
+        // a fault on the page after the last one, or after the pages
+        // brought in around it, continues a sequential run
+        ahead = 0;
+        if (fault.cause == USLOSS_MMU_ACCESS)
+            ; // a write to a page that is in
+        else if (fault.pageNum == proc->nextFault) {
+            proc->seqRun++;
+            ahead = faultAround;
+            if (proc->seqRun <= 5 && (1 << (proc->seqRun - 1)) < ahead)
+                ahead = 1 << (proc->seqRun - 1);
         }
+        else
+            proc->seqRun = 0;
+        proc->nextFault = fault.pageNum + 1 + ahead;
 
-        /* If there isn't one then use clock algorithm to
-         * replace a page (perhaps write to disk) */
-        else {
-            int access;
-            if (debug5) 
-                USLOSS_Console("Pager: no free frame found, doing clock algo... \n");
+        if (debug5) 
+            USLOSS_Console("Pager: page %d is in, unblocking process %d \n", fault.pageNum, fault.pid);
+        /* Unblock waiting (faulting) process */
+        MboxSend(fault.replyMbox, 0, 0);
 
-            while (frame == -1) {
-                sempReal(clockSem); // get mutex
-                USLOSS_MmuGetAccess(clockHand, &access); // get access bits
+        // fault-around: bring in the next pages of the run while the
+        // process goes on, as long as there are free frames
+        for (i = 1; i <= ahead && fault.pageNum + i < proc->numPages; i++) {
+            if (!pageClaim(proc, fault.pid, fault.pageNum + i))
+                break;
+            if (pageIn(proc, fault.pid, fault.pageNum + i, window, 0) == -1)
+                break;
+            faultAroundPages++;
+        }
+    }
+    return 0;
+} /* Pager */
 
-                // if frame is unreferenced (and not being used by another process), use it!
-                if ((access & 1) == 0) { // and check if it is not chosen by another pager...
-                    frame = clockHand;
-                    if (debug5)
-                        USLOSS_Console("Pager: replacing frame %d, prev page: %d, prev owner: proc %d \n", clockHand, frameTable[frame].page, frameTable[frame].pid);
-                    // TODO: mark frame to not be used by other pagers
 
-                    // update old page
-                    oldPage = &processes[frameTable[frame].pid].pageTable[frameTable[frame].page];
-                    oldPage->frame = -1;
-                    oldPage->state = INCORE;
-                }
+/* Claims the page for the pager to bring in, if its process is still
+ * there and the page is neither in a frame nor being paged. Returns 1 if
+ * it was claimed. */
+static int pageClaim(Process *proc, int pid, int pageNum)
+{
+    int claimed = 0;
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (proc->pid == pid && proc->pageTable != NULL) {
+        PTE *page = &proc->pageTable[pageNum];
+        if (page->state == UNUSED || page->state == INCORE) {
+            page->state = INCOMING;
+            shareState(page->share, pageNum, INCOMING);
+            claimed = 1;
+        }
+    }
 
-                else { // clear reference bit
-                    USLOSS_MmuSetAccess(clockHand, (access & 2));
-                    if (debug5) 
-                        USLOSS_Console("Pager: cleared reference bit for frame %d, now access is %d \n", clockHand, access & 1);
-                }
+    USLOSS_PsrSet(psr);
+    return claimed;
+} /* pageClaim */
+
+
+/* Maps the shared zero frame, read-only, for a page the pager claimed
+ * that was never used; the first write to it gives it a frame of its
+ * own (cowBreak), and a page that is only read never needs one */
+static void zeroMap(Process *proc, int pid, int pageNum)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (proc->pid == pid && proc->pageTable != NULL) {
+        proc->pageTable[pageNum].cow = 1;
+        frameShare(proc, pageNum, zeroFrame);
+        vmStats.new++;
+        zeroMapped++;
+    }
+
+    USLOSS_PsrSet(psr);
+    claimRelease();
+} /* zeroMap */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * pageIn
+ *
+ * Brings a page the pager has claimed (state INCOMING) into a frame,
+ * zeroing the frame if the page was never written out, or reading it
+ * from its disk block. For the faulting page (demand) a page is
+ * replaced if there is no free frame; fault-around only takes free
+ * frames. The other pages of a shared memory region get the frame too.
+ *
+ * Results:
+ * The frame, or -1 if there was no free frame for fault-around or the
+ * page's process quit meanwhile.
+ *
+ * Side effects:
+ * Another page may be written out and lose its frame.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+pageIn(Process *proc, int pid, int pageNum, int window, int demand)
+{
+    int frame, psr, gone, member;
+    char *addr;
+    DTE *diskBlock;
+    Process *owner, *other;
+    PTE *page;
+
+    // the process is there, since the page was just claimed
+    int pageBlock = proc->pageTable[pageNum].diskBlock;
+    int share = proc->pageTable[pageNum].share;
+
+    frame = frameGet(window, demand, pageBlock == -1);
+
+    // fault-around doesn't replace pages; give the page back
+    if (frame == -1) {
+        psr = USLOSS_PsrGet();
+        USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+        if (proc->pid == pid && proc->pageTable != NULL)
+            proc->pageTable[pageNum].state = pageBlock == -1 ? UNUSED : INCORE;
+        shareState(share, pageNum, pageBlock == -1 ? UNUSED : INCORE);
+        if (share != 0 && regions[share].pid == -1) // its members all quit
+            regionFree(share);
+        USLOSS_PsrSet(psr);
+        claimRelease();
+        return -1;
+    }
+
+    addr = windowMap(window, 0, frame, USLOSS_MMU_PROT_RW);
+
+    // zero out if this is the first time it has been used, unless the
+    // frame zeroer already did
+    if (pageBlock == -1) {
+        if (!frameTable[frame].zeroed)
+            memset(addr, 0, USLOSS_MmuPageSize());
+        else if (demand)
+            zeroPoolHits++;
+        if (demand)
+            vmStats.new++; // increment new
+        if (debug5) 
+            USLOSS_Console("pageIn: zeroed frame %d \n", frame);
+    }
+
+    // load page from disk
+    else {
+        diskBlock = &diskTable[pageBlock];
+        if (debug5) 
+            USLOSS_Console("pageIn: reading contents of page %d from disk block %d, track %d, sector %d to frame %d \n", 
+                pageNum, pageBlock, diskBlock->track, diskBlock->sector, frame);
+        // read from disk straight into the frame
+        diskReadReal (SWAPDISK, diskBlock->track, diskBlock->sector,
+                      USLOSS_MmuPageSize()/USLOSS_DISK_SECTOR_SIZE, addr);
+        if (demand)
+            vmStats.pageIns++; // increment pages loaded
+    }
+
+    windowUnmap(window, 1);
+    USLOSS_MmuSetAccess(frame, 0); // set page to be not referenced and clean
+
+    // update frame table and page table, and give the frame up to the
+    // replacement policy, unless the process quit meanwhile; the rest of
+    // a shared region gets it even if it did
+    psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    gone = proc->pid != pid || proc->pageTable == NULL;
+    owner = NULL;
+    if (!gone) {
+        frameUse(proc, pageNum, frame);
+        owner = proc;
+    }
+    member = share != 0 ? regions[share].pid : -1;
+    while (member != -1) {
+        other = &processes[member % MAXPROC];
+        page = &other->pageTable[pageNum];
+        if (page->state == INCOMING) {
+            if (owner == NULL) {
+                frameUse(other, pageNum, frame);
+                owner = other;
+            }
+            else
+                frameShare(other, pageNum, frame);
+        }
+        member = page->shareNext != regions[share].pid ? page->shareNext : -1;
+    }
+    if (share != 0 && regions[share].pid == -1)
+        regionFree(share);
+    if (owner == NULL)
+        frameFree(frame);
+    USLOSS_PsrSet(psr);
+    claimRelease();
+
+    if (debug5) 
+        USLOSS_Console("pageIn: set page %d of proc %d to frame %d \n", pageNum, pid, gone ? -1 : frame);
+    return gone ? -1 : frame;
+} /* pageIn */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * frameGet
+ *
+ * Gets a frame for a pager to fill: a free one, zeroed already if zero
+ * is set and there is one, or if there are none and demand is set, one
+ * the replacement policy takes from its page(s), writing it out first
+ * if it is dirty. The frame is CLAIMED; its zeroed field tells whether
+ * it is all zeros.
+ *
+ * Results:
+ * The frame, or -1 if there is no free frame and demand isn't set.
+ *
+ * Side effects:
+ * Another page may be written out and lose its frame.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+frameGet(int window, int demand, int zero)
+{
+    int frame, events, block, access, oldPageNum, share, psr, i;
+    int cluster[SWAP_CLUSTER], n; // frames written out with the old page
+    PTE *oldPage;
+
+    /* Look for free frame */
+    frame = frameAlloc(zero);
+    if (vmStats.freeFrames < freeLow || frame == -1) {
+        if (daemonPid != -1 && !daemonWaking) {
+            daemonWaking = 1;
+            semvReal(daemonSem);
+        }
+    }
+    zeroWake();
+    if (frame != -1) {
+        frameTable[frame].state = CLAIMED;
+        if (debug5) 
+            USLOSS_Console("frameGet: found frame %d free; free frames = %d \n", frame, vmStats.freeFrames);
+        return frame;
+    }
+    if (!demand)
+        return -1;
+
+    /* If there isn't one then have the replacement policy choose
+     * a page to replace (perhaps write to disk) */
+    if (debug5) 
+        USLOSS_Console("frameGet: no free frame found, asking %s policy... \n", policy->name);
+
+    block = -1;
+    share = 0;
+    while (frame == -1) {
+        events = claimEvents;
+
+        // choose and claim the frame with interrupts off, so no other
+        // pager, the daemon or the old owner gets in between
+        psr = USLOSS_PsrGet();
+        USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+        frame = policy->victim();
+        if (frame != -1) {
+            if (debug5)
+                USLOSS_Console("frameGet: replacing frame %d, prev page: %d, prev owner: proc %d \n", frame, frameTable[frame].page, frameTable[frame].pid);
+            frameTable[frame].state = CLAIMED;
+            USLOSS_MmuGetAccess(frame, &access);
+
+            // update old page, and any others sharing the frame
+            oldPageNum = frameTable[frame].page;
+            oldPage = &processes[frameTable[frame].pid % MAXPROC].pageTable[oldPageNum];
+            if (access & USLOSS_MMU_DIRTY) {
+                block = blockClaim(frame, oldPage);
+                n = clusterGather(frame, block, cluster);
+                share = oldPage->share; // its pages stay OUTGOING till written
+                frameDetach(frame, OUTGOING);
+            }
+            else // clean, and never written if it has no block
+                frameDetach(frame, oldPage->diskBlock == -1 ? UNUSED : INCORE);
+        }
+        USLOSS_PsrSet(psr);
+
+        // every frame is claimed or being cleaned; take one that was
+        // freed meanwhile, or wait for a claim to end
+        if (frame == -1 && (frame = frameAlloc(zero)) != -1)
+            frameTable[frame].state = CLAIMED;
+        else if (frame == -1)
+            claimWait(events);
+    }
+
+    // save frame to diiisk 
+    if (block != -1) {
+        clusterWrite(cluster, n, block, frameTable[frame].pid, window);
+
+        // the page can be faulted back in by the processes still there
+        psr = USLOSS_PsrGet();
+        USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+        for (i = 0; i < MAXPROC; i++) {
+            if (processes[i].pageTable == NULL)
+                continue;
+            oldPage = &processes[i].pageTable[oldPageNum];
+            if (oldPage->state == OUTGOING && oldPage->diskBlock == block)
+                oldPage->state = INCORE;
+        }
+        if (share != 0 && regions[share].pid == -1) // its members all quit
+            regionFree(share);
+        USLOSS_PsrSet(psr);
+        claimRelease();
+    }
+    return frame;
+} /* frameGet */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * cowBreak
+ *
+ * Handles a write to a copy-on-write page in a frame. If other pages
+ * still share the frame, the page is given a copy of it in a frame of
+ * its own (a zeroed one for the shared zero frame); if not, the page is
+ * just made writable. Either way the page stops sharing its disk block,
+ * since it is about to be written.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Another page may be written out and lose its frame.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+cowBreak(Process *proc, int pageNum, int window)
+{
+    int frame, copy, block;
+    PTE *page = &proc->pageTable[pageNum];
+
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    frame = page->frame;
+    if (page->state != INFRAME || !page->cow || frameTable[frame].refs == 1) {
+        // nothing to copy; a page still in a frame can be written
+        if (page->state == INFRAME && page->cow) {
+            block = page->diskBlock;
+            if (block != -1 && diskTable[block].refs > 1) {
+                diskBlockFree(block);
+                page->diskBlock = -1;
+                USLOSS_MmuSetAccess(frame, USLOSS_MMU_REF | USLOSS_MMU_DIRTY); // not on disk
+            }
+            page->cow = 0;
+        }
+        pageRemap(proc, pageNum);
+        USLOSS_PsrSet(psr);
+        return;
+    }
+    USLOSS_PsrSet(psr);
+
+    copy = frameGet(window, 1, frame == zeroFrame);
+
+    // the frame may have been taken while we waited for one; if so the
+    // process faults again and the page is paged in first
+    psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    if (page->state == INFRAME && page->frame == frame && page->cow) {
+        if (frame != zeroFrame) {
+            memcpy(windowMap(window, 1, copy, USLOSS_MMU_PROT_RW),
+                   windowMap(window, 0, frame, USLOSS_MMU_PROT_READ), USLOSS_MmuPageSize());
+            windowUnmap(window, 2);
+            bytesCopied += USLOSS_MmuPageSize();
+            cowCopies++;
+        }
+        else if (!frameTable[copy].zeroed) {
+            memset(windowMap(window, 0, copy, USLOSS_MMU_PROT_RW), 0, USLOSS_MmuPageSize());
+            windowUnmap(window, 1);
+        }
+        else
+            zeroPoolHits++;
+
+        pageUnmap(proc, pageNum);
+        frameDrop(proc, frame);
+        if (page->diskBlock != -1) {
+            diskBlockFree(page->diskBlock);
+            page->diskBlock = -1;
+        }
+        page->cow = 0;
+        frameUse(proc, pageNum, copy);
+        USLOSS_MmuSetAccess(copy, USLOSS_MMU_REF | USLOSS_MMU_DIRTY); // not on disk
+        if (debug5)
+            USLOSS_Console("cowBreak: copied page %d of proc %d from frame %d to %d \n", pageNum, proc->pid, frame, copy);
+    }
+    else
+        frameFree(copy);
+    USLOSS_PsrSet(psr);
+    claimRelease();
+} /* cowBreak */
+
+
+/* Gives the claimed frame to the process's page: the frame goes on its
+ * resident list and to the replacement policy, and the page is mapped.
+ * Called with interrupts off. */
+static void frameUse(Process *proc, int pageNum, int frame)
+{
+    PTE *page = &proc->pageTable[pageNum];
+
+    frameTable[frame].pid = proc->pid;
+    frameTable[frame].page = pageNum;
+    frameTable[frame].state = USED;
+    frameTable[frame].refs = 1;
+    frameTable[frame].zeroed = 0;
+    residentAdd(proc, frame);
+    policy->loaded(frame);
+    page->frame = frame;
+    page->state = INFRAME;
+    pageMap(proc, pageNum, frame);
+} /* frameUse */
+
+/* Takes the frame from every page using it, which are unmapped and set to
+ * the given state, and off its owner's resident list. Called with
+ * interrupts off. */
+static void frameDetach(int frame, int state)
+{
+    int i;
+    int pageNum = frameTable[frame].page;
+    Process *owner = &processes[frameTable[frame].pid % MAXPROC];
+    Process *proc;
+    PTE *page;
+
+    int shared = frameTable[frame].refs > 1;
+
+    residentRemove(owner, frame);
+    for (i = 0; i < MAXPROC; i++) {
+        // only the owner's page uses a frame that isn't shared
+        proc = shared ? &processes[i] : owner;
+        page = proc->pageTable != NULL ? &proc->pageTable[pageNum] : NULL;
+        if (page != NULL && page->state == INFRAME && page->frame == frame) {
+            pageUnmap(proc, pageNum);
+            page->frame = -1;
+            page->state = state;
+            if (proc != owner)
+                proc->borrowed--;
+        }
+        if (!shared)
+            break;
+    }
+    frameTable[frame].refs = 0;
+} /* frameDetach */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * frameDrop
+ *
+ * Drops the process's page's hold on the frame, for a copy-on-write copy
+ * or p1_quit. If other pages still share it, the frame stays with them,
+ * going to one of their processes if the process owned it; otherwise it
+ * is freed, by whoever is writing it out if it is. The page itself is
+ * left alone. Called with interrupts off.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * None.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+frameDrop(Process *proc, int frame)
+{
+    int i;
+    int pageNum = frameTable[frame].page;
+    Process *other;
+
+    if (frameTable[frame].refs == 1) {
+        residentRemove(proc, frame);
+        // a frame being written out is freed by the writer once it is done
+        // (PageDaemon, clusterWrite), so no one fills it during the write
+        if (frameTable[frame].state == PAGEOUT) {
+            frameTable[frame].pid = -1;
+            frameTable[frame].refs = 0;
+        }
+        else
+            frameFree(frame);
+        return;
+    }
+
+    frameTable[frame].refs--;
+    if (frameTable[frame].pid != proc->pid) {
+        proc->borrowed--;
+        return;
+    }
+
+    // hand the frame to another process sharing it
+    residentRemove(proc, frame);
+    for (i = 0; i < MAXPROC; i++) {
+        other = &processes[i];
+        if (other != proc && other->pageTable != NULL &&
+            other->pageTable[pageNum].state == INFRAME &&
+            other->pageTable[pageNum].frame == frame)
+            break;
+    }
+    frameTable[frame].pid = other->pid;
+    residentAdd(other, frame);
+    other->borrowed--;
+} /* frameDrop */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PageDaemon
+ *
+ * Kernel process that keeps free frames between the watermarks. Woken
+ * by a pager once free frames drop below freeLow, it has the replacement
+ * policy choose frames: dirty ones are written out, and ones that
+ * weren't used meanwhile are taken from their page and freed, until
+ * freeHigh frames are free.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Pages are written to disk and frames are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+PageDaemon(char *buf)
+{
+    int access, frame, scanned, pid, pageNum, block, psr;
+    int cluster[SWAP_CLUSTER], n;
+    PTE *page;
+
+    while (!isZapped()) {
+        sempReal(daemonSem);
+        daemonWaking = 0;
+        if (isZapped())
+            break;
 
-                clockHand = (clockHand + 1) % vmStats.frames; // increment clock hand
-                semvReal(clockSem); // release mutex
+        // the policy chooses the frames, at most one pass over memory
+        for (scanned = 0; vmStats.freeFrames < freeHigh && scanned < vmStats.frames; scanned++) {
+            psr = USLOSS_PsrGet();
+            USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+            frame = policy->victim();
+            if (frame == -1) {
+                USLOSS_PsrSet(psr);
+                break;
             }
+            // clear the reference bit so a use while writing shows
+            USLOSS_MmuGetAccess(frame, &access);
+            USLOSS_MmuSetAccess(frame, access & USLOSS_MMU_DIRTY);
+            frameTable[frame].state = PAGEOUT; // pagers leave it alone
+            pid = frameTable[frame].pid;
+            pageNum = frameTable[frame].page;
+            page = &processes[pid % MAXPROC].pageTable[pageNum];
+            block = -1;
+            if (access & USLOSS_MMU_DIRTY) {
+                block = blockClaim(frame, page);
+                n = clusterGather(frame, block, cluster);
+            }
+            USLOSS_PsrSet(psr);
 
-            // map page 0 to frame so we can write to it
-            USLOSS_MmuMap(TAG, 0, frame, USLOSS_MMU_PROT_RW);
+            if (block != -1) {
+                clusterWrite(cluster, n, block, pid, DAEMON_WINDOW);
+                daemonCleaned += n;
+            }
 
-            // save frame to diiisk 
-            if (access >= 2) { // if dirty
-                // find disk block for it if it doesn't have one
-                if (oldPage->diskBlock == -1) {
+            // free it unless it was used while we were writing, or its
+            // pages were all dropped (frameDrop); interrupts are off so the
+            // owner can't run. A shared frame may have gone to another
+            // process meanwhile.
+            psr = USLOSS_PsrGet();
+            USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+            if (frameTable[frame].state == PAGEOUT && frameTable[frame].refs == 0)
+                frameFree(frame);
+            else if (frameTable[frame].state == PAGEOUT) {
+                pid = frameTable[frame].pid;
+                page = &processes[pid % MAXPROC].pageTable[pageNum];
+                USLOSS_MmuGetAccess(frame, &access);
+                if (access == 0) {
+                    frameDetach(frame, page->diskBlock == -1 ? UNUSED : INCORE); // never written
+                    frameFree(frame);
+                    daemonFreed++;
                     if (debug5)
-                        USLOSS_Console("Pager: finding disk block for page %d... \n", frameTable[frame].page);
-                    if (vmStats.freeDiskBlocks == 0) {
-                        if (debug5)
-                            USLOSS_Console("Pager: no free disk blocks, halting... \n");
-                        USLOSS_Halt(1);
-                    }
-                    for (i = 0; i < vmStats.diskBlocks; i++) {
-                        if (diskTable[i].pid == -1) {
-                            oldPage->diskBlock = i;
-                            diskTable[i].pid = frameTable[frame].pid;
-                            diskTable[i].page = frameTable[frame].page;
-                            vmStats.freeDiskBlocks--; 
-                            if (debug5)
-                                USLOSS_Console("Pager: found disk block %d for page %d proc %d, free blocks: %d \n", 
-                                    i, diskTable[i].page, diskTable[i].pid, vmStats.freeDiskBlocks);
-                            break;
-                        }
-                    }
+                        USLOSS_Console("PageDaemon: freed frame %d, page %d of proc %d \n", frame, pageNum, pid);
                 }
+                else
+                    frameTable[frame].state = USED;
+            }
+            USLOSS_PsrSet(psr);
+            claimRelease();
+        }
+        zeroWake(); // the frames it freed need zeroing
+    }
+    return 0;
+} /* PageDaemon */
 
-                diskBlock = &diskTable[oldPage->diskBlock];
-                if (debug5)
-                    USLOSS_Console("Pager: page %d dirty, writing to disk track %d, sector %d... \n", 
-                        frameTable[frame].page, diskBlock->track, diskBlock->sector);
-                // copy from memory
-                memcpy(&buffer, vmRegion, USLOSS_MmuPageSize());
-                if (debug5)
-                    USLOSS_Console("Pager: memcopied \n");
-                // write to disk
-                diskWriteReal (SWAPDISK, diskBlock->track, diskBlock->sector,
-                      USLOSS_MmuPageSize()/USLOSS_DISK_SECTOR_SIZE, &buffer);
-                vmStats.pageOuts++; // increment pages saved
-                if (debug5)
-                    USLOSS_Console("Pager: done writing to disk \n");
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FrameZeroer
+ *
+ * Kernel process that keeps zeroPool free frames zeroed, so the pagers
+ * don't have to zero a frame for a new page while the process waits.
+ * It runs at the lowest priority, so frames are only zeroed when nothing
+ * else is ready. Woken by frameGet and the page daemon when the pool is
+ * short and there are free frames to zero.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Free frames are moved to the zeroed frame list.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+FrameZeroer(char *buf)
+{
+    int frame, psr;
+
+    while (!isZapped()) {
+        sempReal(zeroSem);
+        zeroWaking = 0;
+
+        // a frame at a time, with interrupts off so no one gets the frame
+        // half zeroed and VmDestroy can't take the window away meanwhile;
+        // VmDestroy sets zeroerPid to -1 before it does
+        for (frame = 0; frame != -1 && !isZapped(); ) {
+            psr = USLOSS_PsrGet();
+            USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+            frame = zeroerPid != -1 && zeroCount < zeroPool && freeFrames != -1 ? frameAlloc(0) : -1;
+            if (frame != -1) {
+                memset(windowMap(ZERO_WINDOW, 0, frame, USLOSS_MMU_PROT_RW), 0, USLOSS_MmuPageSize());
+                windowUnmap(ZERO_WINDOW, 1);
+                frameTable[frame].zeroed = 1;
+                frameTable[frame].next = zeroFrames;
+                zeroFrames = frame;
+                zeroCount++;
+                vmStats.freeFrames++;
             }
+            USLOSS_PsrSet(psr);
+        }
+    }
+    return 0;
+} /* FrameZeroer */
+
+/* Wakes the frame zeroer if the zeroed frame pool is short and there are
+ * free frames to zero. Not for the dispatcher, since it may block. */
+static void zeroWake(void)
+{
+    if (zeroerPid != -1 && !zeroWaking && zeroCount < zeroPool && freeFrames != -1) {
+        zeroWaking = 1;
+        semvReal(zeroSem);
+    }
+} /* zeroWake */
+
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * blockClaim
+ *
+ * Gives the page in the frame a disk block if it doesn't have one yet,
+ * next to the blocks of the pages around it if it can, and marks the
+ * block as being written so it isn't reused if the page's process quits
+ * before the write is done. Pages sharing the frame share the block.
+ * Called with interrupts off.
+ *
+ * Results:
+ * The disk block.
+ *
+ * Side effects:
+ * Halts if there are no free disk blocks.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+blockClaim(int frame, PTE *page)
+{
+    // find disk block for it if it doesn't have one
+    if (page->diskBlock == -1) {
+        if (debug5)
+            USLOSS_Console("blockClaim: finding disk block for page %d... \n", frameTable[frame].page);
+        int i = diskBlockNear(&processes[frameTable[frame].pid % MAXPROC], frameTable[frame].page);
+        if (i == -1) {
+            if (debug5)
+                USLOSS_Console("blockClaim: no free disk blocks, halting... \n");
+            USLOSS_Halt(1);
+        }
+        page->diskBlock = i;
+        diskTable[i].pid = frameTable[frame].pid;
+        diskTable[i].page = frameTable[frame].page;
+        if (frameTable[frame].refs > 1) {
+            int j;
+            for (j = 0; j < MAXPROC; j++) {
+                PTE *other = processes[j].pageTable != NULL ? &processes[j].pageTable[diskTable[i].page] : NULL;
+                if (other != NULL && other != page && other->state == INFRAME && other->frame == frame) {
+                    other->diskBlock = i;
+                    diskTable[i].refs++;
+                }
+            }
         }
+        if (debug5)
+            USLOSS_Console("blockClaim: found disk block %d for page %d proc %d, free blocks: %d \n", 
+                i, diskTable[i].page, diskTable[i].pid, vmStats.freeDiskBlocks);
+    }
 
-        // map page 0 to frame so we can write to it later
-        USLOSS_MmuMap(TAG, 0, frame, USLOSS_MMU_PROT_RW);
+    diskTable[page->diskBlock].writing = 1;
+    return page->diskBlock;
+} /* blockClaim */
 
-        // zero out if this is the first time it has been used
-        if (page->state == UNUSED) {
-            // vmRegion + page# * PageSize
-            memset(vmRegion, 0, USLOSS_MmuPageSize());
-            vmStats.new++; // increment new
-            if (debug5) 
-                USLOSS_Console("Pager: zeroed frame %d \n", frame);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * clusterGather
+ *
+ * Starts a swap write with the frame, whose page was given the block
+ * with blockClaim, and adds the frames of the pages after it while they
+ * are resident and dirty and their blocks follow on from the block (or
+ * they have none and the next block is free), up to SWAP_CLUSTER pages.
+ * The frames added are marked PAGEOUT so no pager takes them during the
+ * write, and their blocks as being written. Called with interrupts off.
+ *
+ * Results:
+ * The number of frames put in frames, the first being frame.
+ *
+ * Side effects:
+ * None.
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+clusterGather(int frame, int block, int *frames)
+{
+    int n, next, access;
+    int pid = frameTable[frame].pid;
+    int pageNum = frameTable[frame].page;
+    Process *proc = &processes[pid % MAXPROC];
+    PTE *page;
+
+    frames[0] = frame;
+    for (n = 1; n < SWAP_CLUSTER && pageNum + n < proc->numPages; n++) {
+        page = &proc->pageTable[pageNum + n];
+        next = block + n;
+        if (page->state != INFRAME || frameTable[page->frame].state != USED ||
+            frameTable[page->frame].refs > 1)
+            break;
+        USLOSS_MmuGetAccess(page->frame, &access);
+        if ((access & USLOSS_MMU_DIRTY) == 0)
+            break;
+        if (page->diskBlock != next) {
+            if (page->diskBlock != -1 || next >= vmStats.diskBlocks || !diskBlockTake(next))
+                break;
+            page->diskBlock = next;
+            diskTable[next].pid = pid;
+            diskTable[next].page = pageNum + n;
         }
+        diskTable[next].writing = 1;
+        frameTable[page->frame].state = PAGEOUT;
+        frames[n] = page->frame;
+    }
+    return n;
+} /* clusterGather */
 
-        // load page from disk
-        else if (page->diskBlock > -1) {
-            diskBlock = &diskTable[page->diskBlock];
-            if (debug5) 
-                USLOSS_Console("Pager: reading contents of page %d from disk block %d, track %d, sector %d to frame %d \n", 
-                    fault.pageNum, page->diskBlock, diskBlock->track, diskBlock->sector, frame);
-            // read from disk
-            diskReadReal (SWAPDISK, diskBlock->track, diskBlock->sector,
-                          USLOSS_MmuPageSize()/USLOSS_DISK_SECTOR_SIZE, &buffer);
-            // copy to frame
-            memcpy(vmRegion, &buffer, USLOSS_MmuPageSize());
-            vmStats.pageIns++; // increment pages loaded
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * clusterWrite
+ *
+ * Writes the frames gathered by clusterGather to their blocks, starting
+ * at block, in one disk write straight from the given kernel window.
+ * The frames are marked clean first, so if their process writes to one
+ * during the write the dirty bit is set again and the frame isn't
+ * reused before it is written out once more. The frames after the first
+ * go back to USED, or are freed if their pages were dropped meanwhile.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Blocks and frames are freed if their process quit during the write.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+clusterWrite(int *frames, int n, int block, int pid, int window)
+{
+    int i, access;
+    char *addr = NULL;
+    DTE *diskBlock = &diskTable[block];
+
+    if (debug5)
+        USLOSS_Console("clusterWrite: %d pages of proc %d from page %d, writing to disk track %d, sector %d... \n", 
+            n, pid, diskBlock->page, diskBlock->track, diskBlock->sector);
+
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    for (i = 0; i < n; i++) {
+        USLOSS_MmuGetAccess(frames[i], &access);
+        USLOSS_MmuSetAccess(frames[i], access & ~USLOSS_MMU_DIRTY);
+    }
+    USLOSS_PsrSet(psr);
+
+    // write to disk; the disk only reads the window
+    for (i = 0; i < n; i++) {
+        char *page = windowMap(window, i, frames[i], USLOSS_MMU_PROT_READ);
+        if (i == 0)
+            addr = page;
+    }
+    diskWriteReal (SWAPDISK, diskBlock->track, diskBlock->sector,
+          n * USLOSS_MmuPageSize()/USLOSS_DISK_SECTOR_SIZE, addr);
+    windowUnmap(window, n);
+    vmStats.pageOuts += n; // increment pages saved
+    swapWrites++;
+
+    psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    for (i = 0; i < n; i++) {
+        diskTable[block + i].writing = 0;
+        if (diskTable[block + i].refs == 0) // freed while we were writing
+            freeBlockMap[(block + i) / BLOCK_BITS] |= 1u << ((block + i) % BLOCK_BITS);
+        if (i > 0 && frameTable[frames[i]].state == PAGEOUT) {
+            if (frameTable[frames[i]].refs == 0)
+                frameFree(frames[i]);
+            else
+                frameTable[frames[i]].state = USED;
         }
+    }
+    USLOSS_PsrSet(psr);
+    if (debug5)
+        USLOSS_Console("clusterWrite: done writing to disk \n");
+} /* clusterWrite */
+
+/* Maps page i of the kernel window to the frame under every tag, with
+ * the given protection, and returns its address */
+static char *windowMap(int window, int i, int frame, int prot)
+{
+    int tag;
+    int page = vmStats.pages + window * SWAP_CLUSTER + i;
 
-        // unmap pager mapping
-        USLOSS_MmuSetAccess(frame, 0); // set page to be not referenced and clean
-        USLOSS_MmuUnmap(TAG, 0); // unmap page
+    for (tag = 0; tag < USLOSS_MMU_NUM_TAG; tag++)
+        USLOSS_MmuMap(tag, page, frame, prot);
+    return (char *) vmRegion + page * USLOSS_MmuPageSize();
+} /* windowMap */
 
-        // update frame table
-        frameTable[frame].pid = proc->pid;
-        frameTable[frame].page = fault.pageNum;
-        frameTable[frame].state = USED;
+/* Unmaps the first pages of the kernel window */
+static void windowUnmap(int window, int pages)
+{
+    int tag, i;
 
-        // update page table
-        proc->pageTable[fault.pageNum].frame = frame;
-        proc->pageTable[fault.pageNum].state = INFRAME;
+    for (tag = 0; tag < USLOSS_MMU_NUM_TAG; tag++)
+        for (i = 0; i < pages; i++)
+            USLOSS_MmuUnmap(tag, vmStats.pages + window * SWAP_CLUSTER + i);
+} /* windowUnmap */
 
-        if (debug5) 
-            USLOSS_Console("Pager: set page %d to frame %d, unblocking process %d \n", frameTable[frame].page, frame, frameTable[frame].pid);
-        /* Unblock waiting (faulting) process */
-        MboxSend(fault.replyMbox, 0, 0);
+/*
+ * Frames a pager has claimed and pages it is writing out are released
+ * with claimRelease. Pagers that find nothing to replace, or fault on a
+ * page still being written, wait with claimWait for the next release.
+ * claimEvents counts releases, so one that comes after the pager looked
+ * but before it waits isn't missed.
+ */
+
+/* Wakes the pagers waiting for a claim to be released */
+static void claimRelease(void)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    int waiters = claimWaiters;
+    claimWaiters = 0;
+    claimEvents++;
+    USLOSS_PsrSet(psr);
+
+    while (waiters-- > 0)
+        semvReal(claimSem);
+} /* claimRelease */
+
+/* Waits for a claim to be released, unless one has been since claimEvents
+ * was events */
+static void claimWait(int events)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+    if (claimEvents != events) {
+        USLOSS_PsrSet(psr);
+        return;
     }
-    return 0;
-} /* Pager */
+    claimWaiters++;
+    USLOSS_PsrSet(psr);
+    sempReal(claimSem);
+} /* claimWait */
+
+/* Returns the fault histogram bucket for the given service time */
+static int faultHistBucket(int us) {
+    int bucket = 0;
+    int ms = us / 1000;
+
+    while (ms > 0 && bucket < FAULT_HIST_BUCKETS - 1) {
+        ms >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+
+/* ------------------------------------------------------------------------
+   Name - frameAlloc
+   Purpose - Takes the first frame off the zeroed frame list if zero is
+             set, otherwise off the free frame list; off the other list
+             if that one is empty. The lists are only touched with
+             interrupts off, since p1_quit frees frames from inside the
+             dispatcher.
+   Parameters - zero: 1 if the frame is for a new page
+   Returns - the frame, -1 if there are no free frames. Its zeroed field
+             is 1 if it came off the zeroed frame list.
+   ------------------------------------------------------------------------ */
+int frameAlloc(int zero)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    int *list = (zero && zeroFrames != -1) || freeFrames == -1 ? &zeroFrames : &freeFrames;
+    int frame = *list;
+    if (frame != -1) {
+        *list = frameTable[frame].next;
+        frameTable[frame].next = -1;
+        vmStats.freeFrames--;
+        if (list == &zeroFrames)
+            zeroCount--;
+    }
+
+    USLOSS_PsrSet(psr);
+    return frame;
+} /* frameAlloc */
+
+/* Puts the frame back on the free frame list */
+void frameFree(int frame)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    frameTable[frame].pid = -1;
+    frameTable[frame].state = UNUSED;
+    frameTable[frame].page = -1;
+    frameTable[frame].refs = 0;
+    frameTable[frame].zeroed = 0;
+    frameTable[frame].next = freeFrames;
+    freeFrames = frame;
+    vmStats.freeFrames++;
+
+    USLOSS_PsrSet(psr);
+} /* frameFree */
+
+/* Puts the frame on the process's resident list, which p1_switch walks
+ * instead of the whole page table */
+void residentAdd(Process *proc, int frame)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    frameTable[frame].prev = -1;
+    frameTable[frame].next = proc->resident;
+    if (proc->resident != -1)
+        frameTable[proc->resident].prev = frame;
+    proc->resident = frame;
+
+    USLOSS_PsrSet(psr);
+} /* residentAdd */
+
+/* Takes the frame off the process's resident list */
+void residentRemove(Process *proc, int frame)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (frameTable[frame].prev != -1)
+        frameTable[frameTable[frame].prev].next = frameTable[frame].next;
+    else
+        proc->resident = frameTable[frame].next;
+    if (frameTable[frame].next != -1)
+        frameTable[frameTable[frame].next].prev = frameTable[frame].prev;
+    frameTable[frame].next = -1;
+    frameTable[frame].prev = -1;
+
+    USLOSS_PsrSet(psr);
+} /* residentRemove */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * tagLoad
+ *
+ * Makes the process's tag the MMU's current one. Mappings stay under a
+ * process's tag while other processes run, so this only maps its pages
+ * when it has to be given a tag, taking the least recently used one if
+ * they are all in use. Called from p1_switch.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * Another process may lose its tag and mappings.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+tagLoad(Process *proc)
+{
+    int tag = proc->tag;
+    int frame, page;
+
+    if (tag == -1) {
+        tag = tagVictim(-1);
+        if (tagOwners[tag] != -1) {
+            if (debug5)
+                USLOSS_Console("tagLoad: taking tag %d from proc %d for proc %d \n", tag, tagOwners[tag], proc->pid);
+            tagRelease(&processes[tagOwners[tag] % MAXPROC]);
+            tagSteals++;
+        }
+        proc->tag = tag;
+        tagOwners[tag] = proc->pid;
+
+        for (frame = proc->resident; frame != -1; frame = frameTable[frame].next) {
+            page = frameTable[frame].page;
+            if (proc->pageTable[page].state == INFRAME)
+                tagMap(proc, page, frame);
+        }
+        // and the pages it shares in frames other processes own
+        for (page = 0; proc->borrowed > 0 && page < proc->numPages; page++) {
+            frame = proc->pageTable[page].frame;
+            if (proc->pageTable[page].state == INFRAME && frameTable[frame].pid != proc->pid)
+                tagMap(proc, page, frame);
+        }
+    }
+
+    tagLastUsed[tag] = ++tagClock;
+    USLOSS_MmuSetTag(tag);
+} /* tagLoad */
+
+/* Maps the page under the process's tag, taking mappings from other tags
+ * if the MMU is out of them */
+static void tagMap(Process *proc, int page, int frame)
+{
+    int victim;
+    int prot = pageProt(&proc->pageTable[page]);
+    int result = USLOSS_MmuMap(proc->tag, page, frame, prot);
+
+    while (result == USLOSS_MMU_ERR_MAPS && (victim = tagVictim(proc->tag)) != -1 &&
+           tagOwners[victim] != -1) {
+        tagRelease(&processes[tagOwners[victim] % MAXPROC]);
+        tagSteals++;
+        result = USLOSS_MmuMap(proc->tag, page, frame, prot);
+    }
+} /* tagMap */
+
+/* Returns a free process tag, or the least recently used one, other than
+ * keep. Returns -1 if there is no other tag. */
+static int tagVictim(int keep)
+{
+    int tag;
+    int victim = -1;
+
+    for (tag = TAG + 1; tag < USLOSS_MMU_NUM_TAG; tag++) {
+        if (tag == keep)
+            continue;
+        if (tagOwners[tag] == -1)
+            return tag;
+        if (victim == -1 || tagLastUsed[tag] < tagLastUsed[victim])
+            victim = tag;
+    }
+    return victim;
+}
+
+/* Unmaps the process's pages and gives up its tag */
+void tagRelease(Process *proc)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (proc->tag != -1) {
+        int frame, page;
+        for (frame = proc->resident; frame != -1; frame = frameTable[frame].next)
+            USLOSS_MmuUnmap(proc->tag, frameTable[frame].page);
+        for (page = 0; proc->borrowed > 0 && page < proc->numPages; page++) {
+            frame = proc->pageTable[page].frame;
+            if (proc->pageTable[page].state == INFRAME && frameTable[frame].pid != proc->pid)
+                USLOSS_MmuUnmap(proc->tag, page);
+        }
+        tagOwners[proc->tag] = -1;
+        proc->tag = -1;
+    }
+
+    USLOSS_PsrSet(psr);
+} /* tagRelease */
+
+/* Maps the page under the process's tag, if it has one. If the MMU is out
+ * of mappings the process gives up its tag instead, and is mapped again
+ * when it next runs. */
+void pageMap(Process *proc, int page, int frame)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (proc->tag != -1 &&
+        USLOSS_MmuMap(proc->tag, page, frame, pageProt(&proc->pageTable[page])) != USLOSS_MMU_OK)
+        tagRelease(proc);
+
+    USLOSS_PsrSet(psr);
+} /* pageMap */
+
+/* Unmaps the page from the process's tag, if it has one */
+void pageUnmap(Process *proc, int page)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (proc->tag != -1)
+        USLOSS_MmuUnmap(proc->tag, page);
+
+    USLOSS_PsrSet(psr);
+} /* pageUnmap */
+
+/* Maps the page again if it is in a frame, after it lost its mapping or
+ * its protection changed */
+static void pageRemap(Process *proc, int page)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (proc->pageTable[page].state == INFRAME) {
+        pageUnmap(proc, page);
+        pageMap(proc, page, proc->pageTable[page].frame);
+    }
+
+    USLOSS_PsrSet(psr);
+} /* pageRemap */
+
+/* Returns the protection to map the page with: read-only while it is
+ * shared copy-on-write */
+static int pageProt(PTE *page)
+{
+    return page->cow ? USLOSS_MMU_PROT_READ : USLOSS_MMU_PROT_RW;
+} /* pageProt */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * cowShare
+ *
+ * Gives a process being forked its parent's pages, copy-on-write: pages
+ * in frames share the frame, and pages on disk share the disk block,
+ * read-only in both until one of them writes to it. Called by p1_fork
+ * when the parent has copy-on-write forking on.
+ *
+ * Results:
+ * None.
+ *
+ * Side effects:
+ * The parent's shared pages are mapped read-only.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+cowShare(Process *parent, Process *child)
+{
+    int i;
+    PTE *from, *to;
+
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    for (i = 0; i < parent->numPages; i++) {
+        from = &parent->pageTable[i];
+        to = &child->pageTable[i];
+
+        // shared memory stays shared, with the child too
+        if (from->share != 0) {
+            pageShare(parent, child, i);
+            continue;
+        }
+        // nothing to share until it is written, or while it is zeroed
+        if (from->state == UNUSED || (from->state == INCOMING && from->diskBlock == -1))
+            continue;
+
+        to->cow = 1;
+        pageShare(parent, child, i);
+        if (to->state == INCOMING) // fault-around; the child reads the block itself
+            to->state = INCORE;
+        if (!from->cow) {
+            from->cow = 1;
+            pageRemap(parent, i); // read-only now
+        }
+        cowShared++;
+    }
+
+    USLOSS_PsrSet(psr);
+} /* cowShare */
+
+/* Gives the page of to the state, frame and disk block of from's page,
+ * and puts it in the same shared memory region. Whoever writes out or
+ * brings in a page that is OUTGOING or INCOMING does the same for every
+ * page in its region. Called with interrupts off. */
+static void pageShare(Process *from, Process *to, int pageNum)
+{
+    PTE *src = &from->pageTable[pageNum];
+    PTE *dst = &to->pageTable[pageNum];
+
+    dst->state = src->state;
+    if (src->share != 0)
+        regionJoin(src->share, to, pageNum);
+    if (src->diskBlock != -1) {
+        dst->diskBlock = src->diskBlock;
+        diskTable[src->diskBlock].refs++;
+    }
+    if (src->state == INFRAME)
+        frameShare(to, pageNum, src->frame);
+} /* pageShare */
+
+/* Gives the process's page the frame another process owns. Called with
+ * interrupts off. */
+static void frameShare(Process *proc, int pageNum, int frame)
+{
+    PTE *page = &proc->pageTable[pageNum];
+
+    frameTable[frame].refs++;
+    proc->borrowed++;
+    page->frame = frame;
+    page->state = INFRAME;
+    pageMap(proc, pageNum, frame);
+} /* frameShare */
+
+/* Sets the state of every page in the shared memory region, which all
+ * have the same state. Does nothing for a page that isn't shared (share
+ * 0). Called with interrupts off. */
+static void shareState(int share, int pageNum, int state)
+{
+    int pid = share != 0 ? regions[share].pid : -1;
+    PTE *page;
+
+    while (pid != -1) {
+        page = &processes[pid % MAXPROC].pageTable[pageNum];
+        page->state = state;
+        pid = page->shareNext != regions[share].pid ? page->shareNext : -1;
+    }
+} /* shareState */
+
+/* Puts the process's page in a new shared memory region, as its only
+ * member, and returns the region. Called with interrupts off. */
+static int regionAlloc(Process *proc, int pageNum)
+{
+    PTE *page = &proc->pageTable[pageNum];
+    int share = freeRegions;
+
+    // vmInitReal makes enough for every page to have one
+    assert(share != 0);
+    freeRegions = regions[share].next;
+    regions[share].pid = proc->pid;
+    page->share = share;
+    page->shareNext = proc->pid;
+    return share;
+} /* regionAlloc */
+
+/* Adds the process's page to the shared memory region, which has members.
+ * Called with interrupts off. */
+static void regionJoin(int share, Process *proc, int pageNum)
+{
+    PTE *first = &processes[regions[share].pid % MAXPROC].pageTable[pageNum];
+    PTE *page = &proc->pageTable[pageNum];
+
+    page->share = share;
+    page->shareNext = first->shareNext;
+    first->shareNext = proc->pid;
+} /* regionJoin */
+
+/* Takes the process's page out of its shared memory region, for p1_quit
+ * or VmShare. A region left with no members is freed, unless its pages
+ * are being paged in or out: the pager doing it frees it when it is
+ * done, so the region isn't given out again meanwhile. Called with
+ * interrupts off. */
+void regionLeave(Process *proc, int pageNum)
+{
+    PTE *page = &proc->pageTable[pageNum];
+    PTE *prev = page;
+    int share = page->share;
+
+    while (prev->shareNext != proc->pid)
+        prev = &processes[prev->shareNext % MAXPROC].pageTable[pageNum];
+    if (prev != page) {
+        prev->shareNext = page->shareNext;
+        if (regions[share].pid == proc->pid)
+            regions[share].pid = page->shareNext;
+    }
+    else {
+        regions[share].pid = -1;
+        if (page->state != INCOMING && page->state != OUTGOING)
+            regionFree(share);
+    }
+    page->share = 0;
+    page->shareNext = -1;
+} /* regionLeave */
+
+/* Puts the region, which has no members, back on the free list. Called
+ * with interrupts off. */
+static void regionFree(int share)
+{
+    regions[share].next = freeRegions;
+    freeRegions = share;
+} /* regionFree */
+
+/*
+ * Free disk blocks are kept in freeBlockMap, a bit set for each one, so
+ * a given block can be taken to keep a process's pages next to each
+ * other on the disk.
+ */
+
+/* Takes the first free disk block, -1 if there are none */
+int diskBlockAlloc(void)
+{
+    int w;
+    int block = -1;
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    for (w = 0; w < blockWords; w++) {
+        if (freeBlockMap[w] != 0) {
+            block = w * BLOCK_BITS + ffs(freeBlockMap[w]) - 1;
+            freeBlockMap[w] &= ~(1u << (block % BLOCK_BITS));
+            diskTable[block].refs = 1;
+            vmStats.freeDiskBlocks--;
+            break;
+        }
+    }
+
+    USLOSS_PsrSet(psr);
+    return block;
+} /* diskBlockAlloc */
+
+/* Takes the given disk block if it is free. Returns 1 if it was. */
+int diskBlockTake(int block)
+{
+    int taken = 0;
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (freeBlockMap[block / BLOCK_BITS] & (1u << (block % BLOCK_BITS))) {
+        freeBlockMap[block / BLOCK_BITS] &= ~(1u << (block % BLOCK_BITS));
+        diskTable[block].refs = 1;
+        vmStats.freeDiskBlocks--;
+        taken = 1;
+    }
+
+    USLOSS_PsrSet(psr);
+    return taken;
+} /* diskBlockTake */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * diskBlockNear
+ *
+ * Takes a disk block for the process's page: the one after the block of
+ * the page before it, or the one before the block of the page after it.
+ * Failing that, a block in a word of freeBlockMap with no blocks taken,
+ * at the page's place in it, so the pages around it can follow.
+ *
+ * Results:
+ * The block, -1 if there are no free blocks.
+ *
+ * Side effects:
+ * None.
+ *
+ *----------------------------------------------------------------------
+ */
+int
+diskBlockNear(Process *proc, int pageNum)
+{
+    int block, w;
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    block = pageNum > 0 ? proc->pageTable[pageNum - 1].diskBlock : -1;
+    if (block != -1 && block + 1 < vmStats.diskBlocks && diskBlockTake(block + 1)) {
+        USLOSS_PsrSet(psr);
+        return block + 1;
+    }
+    block = pageNum + 1 < proc->numPages ? proc->pageTable[pageNum + 1].diskBlock : -1;
+    if (block > 0 && diskBlockTake(block - 1)) {
+        USLOSS_PsrSet(psr);
+        return block - 1;
+    }
+
+    for (w = 0; w < blockWords; w++) {
+        if (freeBlockMap[w] == ~0u) {
+            block = w * BLOCK_BITS + pageNum % BLOCK_BITS;
+            diskBlockTake(block);
+            USLOSS_PsrSet(psr);
+            return block;
+        }
+    }
+
+    USLOSS_PsrSet(psr);
+    return diskBlockAlloc();
+} /* diskBlockNear */
+
+/* Drops a page's hold on the disk block, freeing it once no page holds
+ * it, or leaving it for clusterWrite if a page is being written to it.
+ * freeDiskBlocks is not given the block back, to match the reported
+ * statistics. */
+void diskBlockFree(int block)
+{
+    int psr = USLOSS_PsrGet();
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
+
+    if (--diskTable[block].refs == 0) {
+        diskTable[block].pid = -1;
+        diskTable[block].page = -1;
+        // clusterWrite frees it once the write it is doing is done
+        if (!diskTable[block].writing)
+            freeBlockMap[block / BLOCK_BITS] |= 1u << (block % BLOCK_BITS);
+    }
+
+    USLOSS_PsrSet(psr);
+} /* diskBlockFree */
 
 
 /* ------------------------------------------------------------------------
@@ -45,4 +45,45 @@ typedef struct VmStats {
 
 extern VmStats	vmStats;
 
+/*
+ * VmTune system call, numbered past the ones in usyscall.h. Its options
+ * are set before VmInit and keep their values across VmDestroy.
+ */
+#define SYS_VMTUNE 39
+
+/*
+ * Fault-around: on a run of faults on pages in sequence, the pagers also
+ * bring in the pages after the faulting one, up to VM_FAULT_AROUND of
+ * them (doubling as the run goes on), if there are free frames. 0, the
+ * default, turns it off.
+ */
+#define VM_FAULT_AROUND 0
+
+/*
+ * New pages: the pagers keep VM_ZERO_POOL free frames zeroed ahead of
+ * time (4 by default, 0 for none) for them. With VM_ZERO_SHARE set to 1,
+ * a new page that is read first is mapped read-only to a single shared
+ * frame of zeros instead, and only given a frame of its own when it is
+ * written.
+ */
+#define VM_ZERO_POOL    1
+#define VM_ZERO_SHARE   2
+
+/*
+ * Page daemon: with VM_PAGE_DAEMON set to 1, the default, a daemon
+ * cleans and frees frames ahead of the pagers' faults (with at least 8
+ * frames); 0 leaves it all to the pagers.
+ */
+#define VM_PAGE_DAEMON  3
+#define VM_OPTIONS      4
+
+/*
+ * Page replacement policies, for VmInitPolicy.
+ */
+#define POLICY_CLOCK    0   // second chance clock (VmInit's default)
+#define POLICY_WSCLOCK  1   // clock over pages out of the working set
+#define POLICY_AGING    2   // LRU approximation with aging counters
+#define POLICY_FIFO     3   // first in, first out
+#define POLICIES        4
+
 #endif /* _PHASE5_H */
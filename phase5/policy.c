@@ -0,0 +1,143 @@
+/*
+ * policy.c
+ *
+ * Page replacement policies for the pagers and the page daemon. Each
+ * policy's victim function is called with interrupts off and returns a
+ * frame holding a page (state USED) to replace, or -1 if it finds none.
+ */
+
+#include "usloss.h"
+#include <vm.h>
+#include <phase5.h>
+
+extern FTE *frameTable;
+extern int clockHand;
+
+static int clockVictim(void);
+static void clockLoaded(int);
+static int wsclockVictim(void);
+static void wsclockLoaded(int);
+static int agingVictim(void);
+static void agingLoaded(int);
+static int fifoVictim(void);
+static void fifoLoaded(int);
+
+Policy policies[POLICIES] = {
+    { "clock",   clockVictim,   clockLoaded },
+    { "wsclock", wsclockVictim, wsclockLoaded },
+    { "aging",   agingVictim,   agingLoaded },
+    { "fifo",    fifoVictim,    fifoLoaded },
+};
+
+int fifoNext; // load order of the next page, for FIFO
+
+
+/* Clock: the first unreferenced frame the hand comes to, clearing the
+ * reference bits it passes over */
+static int clockVictim(void)
+{
+    int i, frame, access;
+
+    // two turns, in case the first only clears bits
+    for (i = 0; i < 2 * vmStats.frames; i++) {
+        frame = clockHand;
+        clockHand = (clockHand + 1) % vmStats.frames;
+        if (frameTable[frame].state != USED)
+            continue;
+        USLOSS_MmuGetAccess(frame, &access);
+        if ((access & USLOSS_MMU_REF) == 0)
+            return frame;
+        USLOSS_MmuSetAccess(frame, access & USLOSS_MMU_DIRTY);
+    }
+    return -1;
+}
+
+static void clockLoaded(int frame)
+{
+}
+
+/* WSClock: like clock, but a page is only replaced once WS_TAU us have
+ * gone by since the hand last saw it used. Clean pages are taken first;
+ * if a turn finds none, the first dirty one. If every page is in the
+ * working set, falls back to clock. */
+static int wsclockVictim(void)
+{
+    int i, frame, access;
+    int now = USLOSS_Clock();
+    int dirty = -1;
+
+    for (i = 0; i < vmStats.frames; i++) {
+        frame = clockHand;
+        clockHand = (clockHand + 1) % vmStats.frames;
+        if (frameTable[frame].state != USED)
+            continue;
+        USLOSS_MmuGetAccess(frame, &access);
+        if (access & USLOSS_MMU_REF) {
+            USLOSS_MmuSetAccess(frame, access & USLOSS_MMU_DIRTY);
+            frameTable[frame].stamp = now;
+            continue;
+        }
+        if (now - frameTable[frame].stamp < WS_TAU)
+            continue;
+        if ((access & USLOSS_MMU_DIRTY) == 0)
+            return frame;
+        if (dirty == -1)
+            dirty = frame;
+    }
+    if (dirty != -1)
+        return dirty;
+    return clockVictim();
+}
+
+static void wsclockLoaded(int frame)
+{
+    frameTable[frame].stamp = USLOSS_Clock();
+}
+
+/* Aging: every frame's age is shifted right, with the reference bit
+ * shifted in at the top, each time a victim is chosen; the youngest
+ * (least recently used) frame is replaced */
+static int agingVictim(void)
+{
+    int frame, access;
+    int victim = -1;
+
+    for (frame = 0; frame < vmStats.frames; frame++) {
+        if (frameTable[frame].state != USED)
+            continue;
+        USLOSS_MmuGetAccess(frame, &access);
+        frameTable[frame].stamp >>= 1;
+        if (access & USLOSS_MMU_REF) {
+            frameTable[frame].stamp |= AGE_TOP;
+            USLOSS_MmuSetAccess(frame, access & USLOSS_MMU_DIRTY);
+        }
+        if (victim == -1 || frameTable[frame].stamp < frameTable[victim].stamp)
+            victim = frame;
+    }
+    return victim;
+}
+
+static void agingLoaded(int frame)
+{
+    frameTable[frame].stamp = AGE_TOP;
+}
+
+/* FIFO: the frame whose page was loaded first */
+static int fifoVictim(void)
+{
+    int frame;
+    int victim = -1;
+
+    for (frame = 0; frame < vmStats.frames; frame++) {
+        if (frameTable[frame].state != USED)
+            continue;
+        if (victim == -1 || frameTable[frame].stamp - frameTable[victim].stamp < 0)
+            victim = frame;
+    }
+    return victim;
+}
+
+static void fifoLoaded(int frame)
+{
+    frameTable[frame].stamp = fifoNext++;
+}
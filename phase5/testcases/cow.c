@@ -0,0 +1,86 @@
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase5.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * Copy-on-write forking: a process fills the region, turns VmCow on and
+ * spawns children that start with its pages. Each child checks it sees
+ * the parent's data, then writes some pages of its own; the parent then
+ * checks its pages weren't changed. Run with enough frames for everyone
+ * and with too few, so shared frames and blocks are paged out too.
+ */
+
+#define PAGES       8
+#define CHILDREN    3
+#define PAGERS      2
+
+char *vmRegion;
+
+int Child(char *arg)
+{
+    int page;
+    int id = arg[0] - '0';
+
+    for (page = 0; page < PAGES; page++)
+        assert(vmRegion[page * USLOSS_MmuPageSize()] == 'A' + page);
+    // each child writes a different number of pages
+    for (page = 0; page <= id; page++)
+        vmRegion[page * USLOSS_MmuPageSize()] = 'a' + id;
+    for (page = 0; page < PAGES; page++)
+        assert(vmRegion[page * USLOSS_MmuPageSize()] == (page <= id ? 'a' + id : 'A' + page));
+    Terminate(0);
+
+    return 0;
+} /* Child */
+
+
+int Parent(char *arg)
+{
+    char name[] = "Child0";
+    char id[] = "0";
+    int i, page, pid, status, result;
+
+    for (page = 0; page < PAGES; page++)
+        vmRegion[page * USLOSS_MmuPageSize()] = 'A' + page;
+
+    result = VmCow(1);
+    assert(result == 0);
+    for (i = 0; i < CHILDREN; i++) {
+        name[5] = id[0] = '0' + i;
+        Spawn(name, Child, id, USLOSS_MIN_STACK * 7, 4, &pid);
+    }
+    for (i = 0; i < CHILDREN; i++)
+        Wait(&pid, &status);
+
+    for (page = 0; page < PAGES; page++)
+        assert(vmRegion[page * USLOSS_MmuPageSize()] == 'A' + page);
+    Terminate(0);
+
+    return 0;
+} /* Parent */
+
+
+int start5(char *arg)
+{
+    int frames[] = { PAGES * (CHILDREN + 1), PAGES / 2 };
+    int i, pid, status, result;
+
+    for (i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        result = VmInit(PAGES, PAGES, frames[i], PAGERS, (void **) &vmRegion);
+        assert(result == 0);
+
+        Spawn("Parent", Parent, NULL, USLOSS_MIN_STACK * 7, 5, &pid);
+        Wait(&pid, &status);
+
+        USLOSS_Console("start5(): %2d frames: %3d faults, %3d new, %3d pageIns, %3d pageOuts\n",
+                       frames[i], vmStats.faults, vmStats.new, vmStats.pageIns, vmStats.pageOuts);
+        VmDestroy();
+    }
+
+    USLOSS_Console("start5(): Test copy-on-write done.\n");
+    Terminate(0);
+
+    return 0;
+} /* start5 */
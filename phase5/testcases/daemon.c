@@ -0,0 +1,75 @@
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase5.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * Page daemon benchmark: a process writes every page of the region in
+ * turn, PASSES times, with half as many frames as pages, timing each
+ * write. It runs without the page daemon and with it, and reports how
+ * the write times (log2 ms, so mostly page faults past the first
+ * bucket) are distributed for each.
+ */
+
+#define PAGES       32
+#define FRAMES      16
+#define PAGERS      2
+#define PASSES      4
+#define BUCKETS     8
+
+char *vmRegion;
+int hist[BUCKETS];
+
+int Child(char *arg)
+{
+    int pass, page, begin, end, bucket, ms;
+
+    for (pass = 0; pass < PASSES; pass++) {
+        for (page = 0; page < PAGES; page++) {
+            GetTimeofDay(&begin);
+            vmRegion[page * USLOSS_MmuPageSize()] = pass * PAGES + page;
+            GetTimeofDay(&end);
+            for (bucket = 0, ms = (end - begin) / 1000; ms > 0 && bucket < BUCKETS - 1; ms >>= 1)
+                bucket++;
+            hist[bucket]++;
+        }
+    }
+    for (page = 0; page < PAGES; page++)
+        assert(vmRegion[page * USLOSS_MmuPageSize()] == (char) ((PASSES - 1) * PAGES + page));
+    Terminate(0);
+
+    return 0;
+} /* Child */
+
+
+int start5(char *arg)
+{
+    int daemon, i, pid, status, result;
+
+    for (daemon = 0; daemon <= 1; daemon++) {
+        result = VmTune(VM_PAGE_DAEMON, daemon);
+        assert(result == 0);
+        result = VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+        assert(result == 0);
+
+        for (i = 0; i < BUCKETS; i++)
+            hist[i] = 0;
+        Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 7, 5, &pid);
+        Wait(&pid, &status);
+
+        USLOSS_Console("start5(): page daemon %s: %3d faults, %3d pageIns, %3d pageOuts\n",
+                       daemon ? "on" : "off", vmStats.faults, vmStats.pageIns, vmStats.pageOuts);
+        USLOSS_Console("start5(): %-10s%8s\n", "write (ms)", "writes");
+        for (i = 0; i < BUCKETS; i++)
+            USLOSS_Console("start5(): %s%-8d%8d\n", i == BUCKETS - 1 ? ">=" : "< ",
+                           i == BUCKETS - 1 ? 1 << (i - 1) : 1 << i, hist[i]);
+        VmDestroy();
+    }
+    VmTune(VM_PAGE_DAEMON, 1);
+
+    USLOSS_Console("start5(): Test page daemon done.\n");
+    Terminate(0);
+
+    return 0;
+} /* start5 */
@@ -0,0 +1,73 @@
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase5.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * Fault storm benchmark: CHILDREN processes write to every page of the
+ * region, PASSES times, with far fewer frames than pages, so nearly
+ * every fault writes a dirty page out and reads one in. It runs with
+ * 1, 2 and 4 pagers and reports how long the storm took; with more
+ * pagers, one can zero-fill or pick a victim while another waits on
+ * the disk.
+ */
+
+#define PAGES       16
+#define FRAMES      4
+#define CHILDREN    4
+#define PASSES      3
+
+char *vmRegion;
+
+int Child(char *arg)
+{
+    int pass, page;
+    int id = atoi(arg);
+
+    for (pass = 0; pass < PASSES; pass++) {
+        for (page = 0; page < PAGES; page++) {
+            char *addr = vmRegion + page * USLOSS_MmuPageSize();
+            if (pass > 0)
+                assert(*addr == id * PASSES + pass - 1);
+            *addr = id * PASSES + pass;
+        }
+    }
+    Terminate(id);
+
+    return 0;
+} /* Child */
+
+
+int start5(char *arg)
+{
+    int pagers, i, pid, status, result, begin, end;
+    char names[CHILDREN][8];
+
+    USLOSS_Console("start5(): %d processes writing %d pages %d times with %d frames\n",
+                   CHILDREN, PAGES, PASSES, FRAMES);
+
+    for (pagers = 1; pagers <= MAXPAGERS; pagers *= 2) {
+        result = VmInit(PAGES, PAGES, FRAMES, pagers, (void **) &vmRegion);
+        assert(result == 0);
+
+        GetTimeofDay(&begin);
+        for (i = 0; i < CHILDREN; i++) {
+            sprintf(names[i], "%d", i);
+            Spawn("Child", Child, names[i], USLOSS_MIN_STACK * 7, 5, &pid);
+        }
+        for (i = 0; i < CHILDREN; i++)
+            Wait(&pid, &status);
+        GetTimeofDay(&end);
+
+        USLOSS_Console("start5(): %d pager(s): %4d faults, %4d pageIns, %4d pageOuts in %d ms\n",
+                       pagers, vmStats.faults, vmStats.pageIns, vmStats.pageOuts,
+                       (end - begin) / 1000);
+        VmDestroy();
+    }
+
+    USLOSS_Console("start5(): Test concurrent pagers done.\n");
+    Terminate(0);
+
+    return 0;
+} /* start5 */
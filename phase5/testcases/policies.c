@@ -0,0 +1,96 @@
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase5.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * Replacement policy benchmark: runs three reference strings under each
+ * replacement policy and reports faults, pageIns and pageOuts for each.
+ *   loop     -- cycles over a few more pages than there are frames
+ *   hot/cold -- 80% of references go to a hot set half the size of memory
+ *   phases   -- a small working set that moves every quarter of the run
+ * One reference in three is a write.
+ */
+
+#define PAGES       16
+#define FRAMES      8
+#define PAGERS      2
+#define REFS        400
+#define PATTERNS    3
+
+char *vmRegion;
+int pattern;
+
+char *policyNames[POLICIES] = { "clock", "wsclock", "aging", "fifo" };
+char *patternNames[PATTERNS] = { "loop", "hot/cold", "phases" };
+
+/* Returns the next pseudo-random number from the given seed */
+int nextRandom(unsigned int *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+/* Returns the page of the i'th reference of the reference string */
+int refPage(int i, unsigned int *seed)
+{
+    int hot = FRAMES / 2;
+
+    switch (pattern) {
+    case 0:
+        return i % (FRAMES + 2);
+    case 1:
+        if (nextRandom(seed) % 10 < 8)
+            return nextRandom(seed) % hot;
+        return hot + nextRandom(seed) % (PAGES - hot);
+    default:
+        return (i / (REFS / 4)) * 3 + nextRandom(seed) % 5;
+    }
+}
+
+int Child(char *arg)
+{
+    unsigned int seed = 1;
+    int i, page, sum = 0;
+
+    for (i = 0; i < REFS; i++) {
+        page = refPage(i, &seed);
+        char *addr = vmRegion + page * USLOSS_MmuPageSize();
+        if (i % 3 == 0)
+            *addr = i;
+        else
+            sum += *addr;
+    }
+    Terminate(sum & 1);
+
+    return 0;
+} /* Child */
+
+
+int start5(char *arg)
+{
+    int policy, pid, status, result;
+
+    USLOSS_Console("start5(): %d references to %d pages with %d frames\n", REFS, PAGES, FRAMES);
+
+    for (policy = 0; policy < POLICIES; policy++) {
+        for (pattern = 0; pattern < PATTERNS; pattern++) {
+            result = VmInitPolicy(PAGES, PAGES, FRAMES, PAGERS, policy, (void **) &vmRegion);
+            assert(result == 0);
+
+            Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 7, 5, &pid);
+            Wait(&pid, &status);
+
+            USLOSS_Console("start5(): %-8s %-9s faults %4d, pageIns %4d, pageOuts %4d\n",
+                           policyNames[policy], patternNames[pattern],
+                           vmStats.faults, vmStats.pageIns, vmStats.pageOuts);
+            VmDestroy();
+        }
+    }
+
+    USLOSS_Console("start5(): Test replacement policies done.\n");
+    Terminate(0);
+
+    return 0;
+} /* start5 */
@@ -0,0 +1,65 @@
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase5.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * Fault-around benchmark: a process writes every page of the region in
+ * order, then reads them back in order, with fault-around off and with
+ * windows of 4 and 8 pages. Reports the faults each scan took, and
+ * checks that fault-around took fewer faults than demand paging alone.
+ */
+
+#define PAGES       32
+#define FRAMES      24
+#define PAGERS      2
+
+char *vmRegion;
+
+int Child(char *arg)
+{
+    int page;
+
+    for (page = 0; page < PAGES; page++)
+        vmRegion[page * USLOSS_MmuPageSize()] = page;
+    for (page = 0; page < PAGES; page++)
+        assert(vmRegion[page * USLOSS_MmuPageSize()] == page);
+    Terminate(0);
+
+    return 0;
+} /* Child */
+
+
+int start5(char *arg)
+{
+    int windows[] = { 0, 4, 8 };
+    int faults[sizeof(windows) / sizeof(windows[0])];
+    int i, pid, status, result;
+
+    USLOSS_Console("start5(): scanning %d pages twice with %d frames\n", PAGES, FRAMES);
+
+    for (i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        result = VmTune(VM_FAULT_AROUND, windows[i]);
+        assert(result == 0);
+        result = VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+        assert(result == 0);
+
+        Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 7, 5, &pid);
+        Wait(&pid, &status);
+
+        USLOSS_Console("start5(): fault-around %d: %3d faults, %3d new, %3d pageIns, %3d pageOuts\n",
+                       windows[i], vmStats.faults, vmStats.new, vmStats.pageIns, vmStats.pageOuts);
+        faults[i] = vmStats.faults;
+        assert(VmTune(VM_FAULT_AROUND, 0) == -2);
+        VmDestroy();
+    }
+
+    for (i = 1; i < sizeof(windows) / sizeof(windows[0]); i++)
+        assert(faults[i] < faults[0]);
+
+    USLOSS_Console("start5(): Test fault-around done.\n");
+    Terminate(0);
+
+    return 0;
+} /* start5 */
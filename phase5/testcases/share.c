@@ -0,0 +1,96 @@
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase5.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * Shared memory: a producer shares its region with a consumer, then the
+ * two take turns filling every page, passing only a one-byte message to
+ * say it is the other's turn. Run with enough frames for both and with
+ * too few, so shared pages are paged out and back in too.
+ */
+
+#define PAGES       8
+#define ROUNDS      4
+#define PAGERS      2
+
+char *vmRegion;
+int toConsumer, toProducer;
+
+int Consumer(char *arg)
+{
+    char round;
+    int page;
+
+    for (;;) {
+        Mbox_Receive(toConsumer, &round, 1);
+        if (round == ROUNDS)
+            break;
+        for (page = 0; page < PAGES; page++) {
+            assert(vmRegion[page * USLOSS_MmuPageSize()] == 'A' + round);
+            vmRegion[page * USLOSS_MmuPageSize()] = 'a' + round;
+        }
+        Mbox_Send(toProducer, &round, 1);
+    }
+    Terminate(0);
+
+    return 0;
+} /* Consumer */
+
+
+int Producer(char *arg)
+{
+    char round;
+    int page, pid, status, result;
+
+    // the consumer has a lower priority, so it doesn't start before
+    // the pages are shared
+    Spawn("Consumer", Consumer, NULL, USLOSS_MIN_STACK * 7, 5, &pid);
+    result = VmShare(pid, 0, PAGES);
+    assert(result == 0);
+
+    for (round = 0; round <= ROUNDS; round++) {
+        if (round < ROUNDS) {
+            for (page = 0; page < PAGES; page++)
+                vmRegion[page * USLOSS_MmuPageSize()] = 'A' + round;
+        }
+        Mbox_Send(toConsumer, &round, 1);
+        if (round < ROUNDS) {
+            Mbox_Receive(toProducer, &round, 1);
+            for (page = 0; page < PAGES; page++)
+                assert(vmRegion[page * USLOSS_MmuPageSize()] == 'a' + round);
+        }
+    }
+    Wait(&pid, &status);
+    Terminate(0);
+
+    return 0;
+} /* Producer */
+
+
+int start5(char *arg)
+{
+    int frames[] = { PAGES * 2, PAGES / 2 };
+    int i, pid, status, result;
+
+    Mbox_Create(1, 1, &toConsumer);
+    Mbox_Create(1, 1, &toProducer);
+
+    for (i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        result = VmInit(PAGES, PAGES, frames[i], PAGERS, (void **) &vmRegion);
+        assert(result == 0);
+
+        Spawn("Producer", Producer, NULL, USLOSS_MIN_STACK * 7, 4, &pid);
+        Wait(&pid, &status);
+
+        USLOSS_Console("start5(): %2d frames: %3d faults, %3d new, %3d pageIns, %3d pageOuts\n",
+                       frames[i], vmStats.faults, vmStats.new, vmStats.pageIns, vmStats.pageOuts);
+        VmDestroy();
+    }
+
+    USLOSS_Console("start5(): Test shared memory done.\n");
+    Terminate(0);
+
+    return 0;
+} /* start5 */
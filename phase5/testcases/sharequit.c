@@ -0,0 +1,95 @@
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase5.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * Shared memory, with a sharer quitting during a page-out: an owner
+ * shares its region with a new sharer each round, which writes every
+ * page and quits at once. There are too few frames for the pages, so
+ * the owner, reading the pages all the while, faults them out and back
+ * in as the sharer quits. Every page must end up with what the sharer
+ * wrote, and never be seen with anything else in between.
+ */
+
+#define PAGES       8
+#define FRAMES      4
+#define ROUNDS      4
+#define PAGERS      2
+
+char *vmRegion;
+int done;
+
+int Sharer(char *arg)
+{
+    char round = arg[0] - '0';
+    int page;
+
+    for (page = 0; page < PAGES; page++)
+        vmRegion[page * USLOSS_MmuPageSize()] = 'A' + round + 1;
+    Mbox_Send(done, &round, 1);
+    Terminate(0);
+
+    return 0;
+} /* Sharer */
+
+
+int Owner(char *arg)
+{
+    char round, name[2], value;
+    int page, pid, status, result;
+
+    // every page gets a disk block, so faults on them wait for the disk
+    // and the sharer gets to run
+    for (page = 0; page < PAGES; page++)
+        vmRegion[page * USLOSS_MmuPageSize()] = 'A';
+
+    for (round = 0; round < ROUNDS; round++) {
+        // the sharer has a lower priority, so it doesn't start before
+        // the pages are shared
+        name[0] = '0' + round;
+        name[1] = '\0';
+        Spawn("Sharer", Sharer, name, USLOSS_MIN_STACK * 7, 5, &pid);
+        result = VmShare(pid, 0, PAGES);
+        assert(result == 0);
+
+        while (Mbox_CondReceive(done, &value, 1) < 0) {
+            for (page = 0; page < PAGES; page++) {
+                value = vmRegion[page * USLOSS_MmuPageSize()];
+                assert(value == 'A' + round || value == 'A' + round + 1);
+            }
+        }
+        Wait(&pid, &status);
+
+        // twice, so each page is paged out and back in after the quit
+        for (page = 0; page < 2 * PAGES; page++)
+            assert(vmRegion[page % PAGES * USLOSS_MmuPageSize()] == 'A' + round + 1);
+    }
+    Terminate(0);
+
+    return 0;
+} /* Owner */
+
+
+int start5(char *arg)
+{
+    int pid, status, result;
+
+    Mbox_Create(1, 1, &done);
+
+    result = VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+    assert(result == 0);
+
+    Spawn("Owner", Owner, NULL, USLOSS_MIN_STACK * 7, 4, &pid);
+    Wait(&pid, &status);
+
+    USLOSS_Console("start5(): %d rounds: %3d faults, %3d new, %3d pageIns, %3d pageOuts\n",
+                   ROUNDS, vmStats.faults, vmStats.new, vmStats.pageIns, vmStats.pageOuts);
+    VmDestroy();
+
+    USLOSS_Console("start5(): Test sharer quitting done.\n");
+    Terminate(0);
+
+    return 0;
+} /* start5 */
@@ -0,0 +1,70 @@
+#include <usloss.h>
+#include <usyscall.h>
+#include <phase5.h>
+#include <libuser.h>
+#include <assert.h>
+
+/*
+ * New pages: a process reads every page of the region, then writes every
+ * other one, and checks what it reads back. Run with no zeroed frame
+ * pool, with the pool, and with the pool and the shared zero frame, so
+ * the pages that are only read never get a frame of their own: the
+ * process ends up using fewer frames with it than without.
+ */
+
+#define PAGES       16
+#define FRAMES      12
+#define PAGERS      2
+
+char *vmRegion;
+int framesUsed; // frames in use when the child is done
+
+int Child(char *arg)
+{
+    int page;
+
+    for (page = 0; page < PAGES; page++)
+        assert(vmRegion[page * USLOSS_MmuPageSize()] == 0);
+    for (page = 0; page < PAGES; page += 2)
+        vmRegion[page * USLOSS_MmuPageSize()] = 'A' + page;
+    for (page = 0; page < PAGES; page++)
+        assert(vmRegion[page * USLOSS_MmuPageSize()] == (page % 2 == 0 ? 'A' + page : 0));
+    framesUsed = vmStats.frames - vmStats.freeFrames;
+    Terminate(0);
+
+    return 0;
+} /* Child */
+
+
+int start5(char *arg)
+{
+    int pools[] = { 0, 4, 4 };
+    int shares[] = { 0, 0, 1 };
+    int used[sizeof(pools) / sizeof(pools[0])];
+    int i, pid, status, result;
+
+    for (i = 0; i < sizeof(pools) / sizeof(pools[0]); i++) {
+        result = VmTune(VM_ZERO_POOL, pools[i]);
+        assert(result == 0);
+        result = VmTune(VM_ZERO_SHARE, shares[i]);
+        assert(result == 0);
+        result = VmInit(PAGES, PAGES, FRAMES, PAGERS, (void **) &vmRegion);
+        assert(result == 0);
+
+        Spawn("Child", Child, NULL, USLOSS_MIN_STACK * 7, 5, &pid);
+        Wait(&pid, &status);
+
+        USLOSS_Console("start5(): pool %d, zero frame %d: %3d faults, %3d new, %3d pageIns, %3d pageOuts, %3d frames\n",
+                       pools[i], shares[i], vmStats.faults, vmStats.new, vmStats.pageIns, vmStats.pageOuts, framesUsed);
+        used[i] = framesUsed;
+        VmDestroy();
+    }
+
+    // with the zero frame, the pages that are only read share one frame
+    assert(used[2] < used[1]);
+
+    USLOSS_Console("start5(): Test new pages done.\n");
+    Terminate(0);
+
+    return 0;
+} /* start5 */
@@ -4,10 +4,34 @@
 
 
 /*
- * All processes use the same tag.
+ * The kernel uses TAG. Processes are given the other tags as they run,
+ * the least recently run process losing its tag when they run out.
  */
 #define TAG 0
 
+/*
+ * Kernel windows: pages past the end of the VM region through which
+ * the pagers and the page daemon reach the frames they work on, one
+ * window of SWAP_CLUSTER pages each. A window is mapped under every tag,
+ * so the disk can read or write the frames through it directly, whatever
+ * process is running. User code can reach a window only while a pager
+ * or the page daemon waits on a disk transfer through it: read-only for
+ * a page-out, read-write for a page-in. Otherwise the windows are
+ * unmapped, and a process that touches one is terminated (FaultHandler).
+ */
+#define WINDOWS (MAXPAGERS + 2)
+#define DAEMON_WINDOW MAXPAGERS
+#define ZERO_WINDOW (MAXPAGERS + 1)
+
+/*
+ * A page written to swap takes the dirty resident pages after it along,
+ * up to SWAP_CLUSTER pages in one disk write, when their blocks follow
+ * its block. Blocks are given out next to the blocks of the pages
+ * around them so that they do.
+ */
+#define SWAP_CLUSTER 8
+#define BLOCK_BITS (8 * sizeof(unsigned int)) // blocks per freeBlockMap word
+
 /*
  * Different states for a page.
  */
@@ -16,7 +40,44 @@
 #define INFRAME 502 // in the frame table
 
 #define USED 503 // frame that is mapped to a page in memory
-#define SWAPDISK 1 // disk to use
+#define PAGEOUT 504 // frame being cleaned by the page daemon
+#define CLAIMED 505 // frame taken by a pager, being cleaned and filled
+#define OUTGOING 506 // page whose frame was taken, being written to disk
+#define INCOMING 507 // page a pager is bringing into a frame
+#define ZEROFRAME 508 // the shared zero frame, never replaced
+#define SWAPDISK 1 // disk to use, DISK_STRIPED stripes swap over both units
+
+/*
+ * The page daemon cleans and frees frames once fewer than frames/FREE_LOW
+ * are free, until frames/FREE_HIGH are. It isn't started with fewer than
+ * FREE_HIGH frames, or with the VM_PAGE_DAEMON option off.
+ */
+#define FREE_LOW 16
+#define FREE_HIGH 8
+
+/*
+ * The frame zeroer runs at the lowest priority a process can have, so it
+ * only zeroes frames when the system is otherwise idle.
+ */
+#define ZEROER_PRIORITY 5
+
+#define FAULT_HIST_BUCKETS 12 // fault service time histogram, log2 ms
+
+/*
+ * Page replacement policy. victim is called with interrupts off and
+ * returns a USED frame to replace, or -1 if it finds none; loaded is
+ * called, also with interrupts off, when a page is put in a frame.
+ */
+typedef struct Policy {
+    char *name;
+    int  (*victim)(void);
+    void (*loaded)(int frame);
+} Policy;
+
+extern Policy policies[]; // indexed by POLICY_*, see phase5.h
+
+#define WS_TAU   100000    // us a page stays in the working set (WSClock)
+#define AGE_TOP  (1 << 30) // aging: bit set in the age of a used frame
 
 /*
  * Page table entry.
@@ -25,6 +86,13 @@ typedef struct PTE {
     int  state;      // See above.
     int  frame;      // Frame that stores the page (if any). -1 if none.
     int  diskBlock;  // Disk block that stores the page (if any). -1 if none.
+    int  cow;        // 1 if the frame or block is shared copy-on-write,
+                     //   so the page is mapped read-only.
+    int  share;      // Shared memory region (VmShare) the page is in, 0 if
+                     //   none. Its pages in every process always have the
+                     //   same state, frame and disk block.
+    int  shareNext;  // pid of the next process in the ring of the region's
+                     //   members, this one's own if it is the only one.
     // Add more stuff here
 } PTE;
 
@@ -33,7 +101,14 @@ typedef struct FTE {
     int pid;        // pid of process using the frame, -1 if none
     int state;      // whether it is free/in use
     int page;       // the page using this frame
-    // other stuff
+    int next;       // next frame on the free list or the owner's
+                    //   resident list, -1 if last
+    int prev;       // previous frame on the resident list, -1 if first
+    int stamp;      // replacement policy's data: load order (FIFO), last
+                    //   use (WSClock) or age (aging)
+    int refs;       // pages using the frame; more than 1 if it is shared
+                    //   copy-on-write, all at the same page number
+    int zeroed;     // 1 if the free frame is known to be all zeros
 } FTE;
 
 /* Disk table entry */
@@ -42,8 +117,18 @@ typedef struct DTE {
     int page;       // the page using this disk block
     int track;      // what track the page is on
     int sector;     // sector it starts on
+    int writing;    // 1 while a page is being written to it
+    int refs;       // pages using the block
 } DTE;
 
+/* Shared memory region table entry, indexed by PTE.share. A region is a
+ * page at the same page number in each of its members, whose pages are
+ * linked in a ring through shareNext. */
+typedef struct Region {
+    int pid;        // pid of a member, -1 if it has none
+    int next;       // next free region, 0 if last, while it is free
+} Region;
+
 /*
  * Per-process information.
  */
@@ -52,6 +137,14 @@ typedef struct Process {
     PTE  *pageTable; // The page table for the process.
     // Add more stuff here */
     int  pid;
+    int  resident;   // First frame holding one of its pages, -1 if none.
+    int  tag;        // MMU tag its pages are mapped under, -1 if none.
+    int  nextFault;  // Page a sequential run would fault on next.
+    int  seqRun;     // Sequential faults in a row, for fault-around.
+    int  cowFork;    // 1 if processes it spawns share its pages
+                     //   copy-on-write.
+    int  borrowed;   // Its pages in shared frames another process owns
+                     //   (has on its resident list).
 } Process;
 
 /*
@@ -63,6 +156,8 @@ typedef struct FaultMsg {
     void *addr;      // Address that caused the fault.
     int  replyMbox;  // Mailbox to send reply.
     int pageNum;     // the page the fault occurred on
+    int cause;       // USLOSS_MMU_FAULT, or USLOSS_MMU_ACCESS for a write
+                     //   to a copy-on-write page
     // Add more stuff here.
 } FaultMsg;
 